@@ -0,0 +1,136 @@
+// Response-handling latency of the blocking vs busy-polling event loop.
+// A local websocketpp echo server bounces each message back; the time from
+// send() on the main thread to the client's message handler running on its
+// I/O thread is recorded per mode. Messages are paced so the I/O thread is
+// idle (and, in blocking mode, asleep) when each echo arrives.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include <fmt/core.h>
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/server.hpp>
+#include <websocketpp/client.hpp>
+
+#include "latency/histogram.h"
+#include "websocket/io_loop.h"
+
+using namespace std;
+
+typedef websocketpp::server<websocketpp::config::asio> echo_server;
+typedef websocketpp::client<websocketpp::config::asio_client> bench_client;
+
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static HistogramSnapshot run_mode(unsigned short port, long busy_poll_us, int iterations) {
+    bench_client client;
+    client.clear_access_channels(websocketpp::log::alevel::all);
+    client.clear_error_channels(websocketpp::log::elevel::all);
+    client.init_asio();
+
+    io_loop_mode mode;
+    mode.busy_poll_us.store(busy_poll_us);
+
+    atomic<bool> opened(false);
+    atomic<uint64_t> handled_at(0);
+
+    client.set_open_handler([&opened](websocketpp::connection_hdl) {
+        opened.store(true, memory_order_release);
+    });
+    client.set_message_handler([&handled_at](websocketpp::connection_hdl, bench_client::message_ptr) {
+        handled_at.store(now_ns(), memory_order_release);
+    });
+
+    websocketpp::lib::error_code ec;
+    bench_client::connection_ptr con = client.get_connection("ws://127.0.0.1:" + to_string(port), ec);
+    if (ec) {
+        fmt::print("connect failed: {}\n", ec.message());
+        exit(1);
+    }
+    client.connect(con);
+
+    thread io([&client, &mode]() { run_io_loop(client.get_io_service(), mode); });
+
+    while (!opened.load(memory_order_acquire)) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    const string payload(128, 'x');
+    HistogramSnapshot samples;
+
+    for (int i = 0; i < iterations; ++i) {
+        // Let the I/O thread go idle before the next message
+        this_thread::sleep_for(chrono::microseconds(200));
+
+        handled_at.store(0, memory_order_relaxed);
+        uint64_t sent_at = now_ns();
+        client.send(con->get_handle(), payload, websocketpp::frame::opcode::text, ec);
+        if (ec) break;
+
+        // Spin so the measuring side adds no wakeup of its own
+        uint64_t received;
+        while ((received = handled_at.load(memory_order_acquire)) == 0) {
+            io_loop_cpu_relax();
+        }
+        samples.record(received - sent_at);
+    }
+
+    client.close(con->get_handle(), websocketpp::close::status::normal, "", ec);
+    io.join();
+    return samples;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+    unsigned short port = argc > 2 ? static_cast<unsigned short>(atoi(argv[2])) : 9465;
+    if (iterations <= 0) iterations = 20000;
+
+    echo_server server;
+    server.clear_access_channels(websocketpp::log::alevel::all);
+    server.clear_error_channels(websocketpp::log::elevel::all);
+    server.init_asio();
+    server.set_reuse_addr(true);
+    server.set_message_handler([&server](websocketpp::connection_hdl hdl, echo_server::message_ptr msg) {
+        websocketpp::lib::error_code ec;
+        server.send(hdl, msg->get_payload(), msg->get_opcode(), ec);
+    });
+    server.listen(websocketpp::lib::asio::ip::tcp::v4(), port);
+    server.start_accept();
+
+    thread server_thread([&server]() { server.run(); });
+
+    struct bench_mode {
+        const char* name;
+        long busy_poll_us;
+    };
+    const bench_mode modes[] = {
+        {"blocking run_one()", -1},
+        {"busy-poll", 0},
+        {"busy-poll, 50 µs back-off", 50}
+    };
+
+    fmt::print("Echo round trips per mode: {}\n\n", iterations);
+    fmt::print("{:<28} {:>10} {:>10} {:>10} {:>10}\n", "Mode", "p50 µs", "p99 µs", "p99.9 µs", "max µs");
+
+    for (auto const &mode : modes) {
+        HistogramSnapshot samples = run_mode(port, mode.busy_poll_us, iterations);
+        fmt::print("{:<28} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f}\n", mode.name,
+                   samples.value_at_quantile(0.5) / 1000.0,
+                   samples.value_at_quantile(0.99) / 1000.0,
+                   samples.value_at_quantile(0.999) / 1000.0,
+                   samples.max() / 1000.0);
+    }
+
+    server.stop_listening();
+    server.stop();
+    server_thread.join();
+    return 0;
+}
@@ -0,0 +1,211 @@
+// CPU cost vs bytes saved by permessage-deflate on feed traffic.
+//
+//   ./deflate_bench [messages-file] [link_mbps]
+//
+// messages-file is a history spill written by `history_spill` (gzip,
+// "<seq>\t<RECEIVED: json>" lines) or any file with one JSON message per
+// line, plain or gzipped; sent messages are skipped. Without one, synthetic
+// book.* change notifications are used. Each message is compressed as a
+// permessage-deflate sender would (raw deflate, sync flush, trailing
+// 00 00 ff ff stripped) and inflated back as the client would, with and
+// without context takeover. With link_mbps, the transfer time saved per
+// message on a link of that bandwidth is set against the inflate cost.
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <zlib.h>
+
+using namespace std;
+
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static vector<string> load_messages(const char* path) {
+    vector<string> messages;
+    gzFile file = gzopen(path, "rb");
+    if (!file) return messages;
+
+    string line;
+    char buffer[65536];
+    while (gzgets(file, buffer, sizeof(buffer))) {
+        line += buffer;
+        if (line.empty() || line.back() != '\n') continue;
+        line.pop_back();
+
+        size_t json_start = line.find('{');
+        if (json_start != string::npos && line.rfind("SENT: ", json_start) == string::npos) {
+            messages.push_back(line.substr(json_start));
+        }
+        line.clear();
+    }
+    gzclose(file);
+    return messages;
+}
+
+static vector<string> synthetic_messages(size_t count) {
+    const char* instruments[] = {"BTC-PERPETUAL", "ETH-PERPETUAL", "BTC-27DEC24", "ETH-27DEC24"};
+    mt19937 rng(42);
+    uniform_int_distribution<int> levels(1, 20);
+    uniform_int_distribution<int> ticks(-200, 200);
+    uniform_real_distribution<double> amounts(10.0, 50000.0);
+
+    vector<string> messages;
+    int64_t change_id = 68000000000;
+    int64_t timestamp = 1733000000000;
+
+    for (size_t i = 0; i < count; ++i) {
+        const char* instrument = instruments[i % 4];
+        double mid = (i % 2 == 0) ? 97000.0 : 3600.0;
+
+        auto side = [&](double direction) {
+            string levels_json = "[";
+            int n = levels(rng);
+            for (int level = 0; level < n; ++level) {
+                if (level) levels_json += ",";
+                levels_json += fmt::format("[\"{}\",{:.1f},{:.1f}]", level % 5 == 0 ? "delete" : "change",
+                                           mid + direction * (0.5 * (level + 1) + ticks(rng) * 0.5), amounts(rng));
+            }
+            return levels_json + "]";
+        };
+
+        timestamp += 100;
+        messages.push_back(fmt::format(
+            "{{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{{\"channel\":\"book.{}.100ms\","
+            "\"data\":{{\"type\":\"change\",\"timestamp\":{},\"instrument_name\":\"{}\",\"prev_change_id\":{},"
+            "\"change_id\":{},\"bids\":{},\"asks\":{}}}}}}}",
+            instrument, timestamp, instrument, change_id, change_id + 1, side(-1.0), side(1.0)));
+        ++change_id;
+    }
+    return messages;
+}
+
+struct result {
+    size_t raw_bytes = 0;
+    size_t wire_bytes = 0;
+    uint64_t deflate_ns = 0;
+    uint64_t inflate_ns = 0;
+    bool round_trip_ok = true;
+};
+
+static result run(vector<string> const &messages, int level, bool context_takeover) {
+    result r;
+
+    z_stream deflater{};
+    z_stream inflater{};
+    deflateInit2(&deflater, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    inflateInit2(&inflater, -15);
+
+    vector<unsigned char> compressed;
+    vector<unsigned char> inflated;
+    static const unsigned char tail[4] = {0x00, 0x00, 0xff, 0xff};
+
+    for (auto const &message : messages) {
+        compressed.resize(deflateBound(&deflater, message.size()) + 16);
+
+        uint64_t start = now_ns();
+        if (!context_takeover) deflateReset(&deflater);
+        deflater.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+        deflater.avail_in = message.size();
+        deflater.next_out = compressed.data();
+        deflater.avail_out = compressed.size();
+        deflate(&deflater, Z_SYNC_FLUSH);
+        size_t size = compressed.size() - deflater.avail_out - 4;
+        r.deflate_ns += now_ns() - start;
+
+        // The receiver puts the stripped tail back before inflating
+        compressed.resize(size);
+        compressed.insert(compressed.end(), tail, tail + 4);
+        inflated.resize(message.size() + 64);
+
+        start = now_ns();
+        if (!context_takeover) inflateReset(&inflater);
+        inflater.next_in = compressed.data();
+        inflater.avail_in = compressed.size();
+        inflater.next_out = inflated.data();
+        inflater.avail_out = inflated.size();
+        inflate(&inflater, Z_SYNC_FLUSH);
+        r.inflate_ns += now_ns() - start;
+
+        size_t inflated_size = inflated.size() - inflater.avail_out;
+        if (inflated_size != message.size() || memcmp(inflated.data(), message.data(), inflated_size) != 0) {
+            r.round_trip_ok = false;
+        }
+
+        r.raw_bytes += message.size();
+        r.wire_bytes += size;
+    }
+
+    deflateEnd(&deflater);
+    inflateEnd(&inflater);
+    return r;
+}
+
+int main(int argc, char** argv) {
+    vector<string> messages;
+    if (argc > 1) {
+        messages = load_messages(argv[1]);
+        if (messages.empty()) {
+            fmt::print("no messages read from {}\n", argv[1]);
+            return 1;
+        }
+    } else {
+        messages = synthetic_messages(20000);
+    }
+    double link_mbps = argc > 2 ? atof(argv[2]) : 0;
+
+    size_t raw = 0;
+    for (auto const &message : messages) raw += message.size();
+    fmt::print("{} messages, {:.0f} bytes on average{}\n\n", messages.size(), double(raw) / messages.size(),
+               argc > 1 ? "" : " (synthetic book changes)");
+
+    struct mode {
+        const char* name;
+        int level;
+        bool context_takeover;
+    };
+    const mode modes[] = {
+        {"level 1, context takeover", 1, true},
+        {"level 6, context takeover", 6, true},
+        {"level 1, no context takeover", 1, false},
+        {"level 6, no context takeover", 6, false}
+    };
+
+    fmt::print("{:<30} {:>8} {:>14} {:>14} {:>12}", "Mode", "Ratio", "Deflate µs/msg", "Inflate µs/msg",
+               "Inflate MB/s");
+    if (link_mbps > 0) fmt::print(" {:>16}", "Saved µs/msg");
+    fmt::print("\n");
+
+    for (auto const &m : modes) {
+        result r = run(messages, m.level, m.context_takeover);
+        if (!r.round_trip_ok) {
+            fmt::print("{:<30} round trip mismatch\n", m.name);
+            continue;
+        }
+        double n = messages.size();
+        fmt::print("{:<30} {:>7.2f}x {:>14.2f} {:>14.2f} {:>12.0f}", m.name,
+                   double(r.raw_bytes) / r.wire_bytes,
+                   r.deflate_ns / n / 1000.0,
+                   r.inflate_ns / n / 1000.0,
+                   r.raw_bytes / (r.inflate_ns / 1e9) / 1e6);
+        if (link_mbps > 0) {
+            // Serialization delay avoided per message, net of inflating it
+            double saved_us = (double(r.raw_bytes) - double(r.wire_bytes)) * 8.0 / n / link_mbps;
+            fmt::print(" {:>16.2f}", saved_us - r.inflate_ns / n / 1000.0);
+        }
+        fmt::print("\n");
+    }
+
+    if (link_mbps > 0) {
+        fmt::print("\nSaved µs/msg: transfer time saved at {} Mbit/s minus the inflate cost; "
+                   "worth enabling where positive\n", link_mbps);
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+// Large query responses (positions, order book at depth, open orders):
+// heap vs arena-backed DOMs, and pretty-printing by parse + dump(4) vs
+// re-indenting the raw text. Reported as heap allocations per message and
+// microseconds per KB of message text.
+//
+//   ./dom_bench [messages-file]
+//
+// messages-file is a history spill written by `history_spill` or any file
+// with one JSON message per line, plain or gzipped; only responses (with a
+// "result") are used. Without one, synthetic responses are generated.
+// utils::pretty must give the same document back, and for text dump()
+// wrote, the same bytes as dump(4), before anything is timed.
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <nlohmann/json.hpp>
+#include <zlib.h>
+
+#include "utils/arena_json.h"
+#include "utils/utils.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+// Every heap allocation in the process goes through here. Kept out of line
+// so the compiler doesn't pair library news with these frees.
+static size_t g_allocations = 0;
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    ++g_allocations;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static vector<string> load_messages(const char* path) {
+    vector<string> messages;
+    gzFile file = gzopen(path, "rb");
+    if (!file) return messages;
+
+    string line;
+    char buffer[65536];
+    while (gzgets(file, buffer, sizeof(buffer))) {
+        line += buffer;
+        if (line.empty() || line.back() != '\n') continue;
+        line.pop_back();
+
+        size_t json_start = line.find('{');
+        if (json_start != string::npos && line.rfind("SENT: ", json_start) == string::npos &&
+            line.find("\"result\"", json_start) != string::npos) {
+            messages.push_back(line.substr(json_start));
+        }
+        line.clear();
+    }
+    gzclose(file);
+    return messages;
+}
+
+static vector<string> synthetic_messages(size_t count) {
+    mt19937 rng(17);
+    uniform_int_distribution<int> ticks(0, 4000);
+    uniform_int_distribution<int> lots(1, 5000);
+    auto price = [&]() { return 96000.0 + ticks(rng) * 0.5; };
+    auto amount = [&]() { return lots(rng) * 10.0; };
+    const char* instruments[] = {"BTC-PERPETUAL", "ETH-PERPETUAL", "BTC-27DEC24", "BTC-27DEC24-100000-C"};
+
+    vector<string> messages;
+    for (size_t i = 0; i < count; ++i) {
+        json response = {{"jsonrpc", "2.0"}, {"id", 1000 + i}, {"usIn", 1733000000000000 + i},
+                         {"usOut", 1733000000000412 + i}, {"usDiff", 412}, {"testnet", true}};
+        switch (i % 3) {
+            case 0: {
+                json positions = json::array();
+                for (int p = 0; p < 40; ++p) {
+                    positions.push_back({
+                        {"average_price", price()}, {"average_price_usd", price()}, {"delta", 0.0123 * p},
+                        {"direction", p % 2 ? "buy" : "sell"}, {"estimated_liquidation_price", price() / 2},
+                        {"floating_profit_loss", 0.0001 * p}, {"floating_profit_loss_usd", 1.5 * p},
+                        {"index_price", price()}, {"initial_margin", 0.0005}, {"instrument_name", instruments[p % 4]},
+                        {"interest_value", 0.0}, {"kind", p % 4 == 3 ? "option" : "future"}, {"leverage", 50},
+                        {"maintenance_margin", 0.0002}, {"mark_price", price()}, {"open_orders_margin", 0.0},
+                        {"realized_funding", -1.2e-06}, {"realized_profit_loss", 0.0}, {"settlement_price", price()},
+                        {"size", amount()}, {"size_currency", 0.0105}, {"total_profit_loss", 0.00042}
+                    });
+                }
+                response["result"] = positions;
+                break;
+            }
+            case 1: {
+                json bids = json::array(), asks = json::array();
+                for (int level = 0; level < 1000; ++level) {
+                    bids.push_back({price() - 2000, amount()});
+                    asks.push_back({price() + 2000, amount()});
+                }
+                response["result"] = {
+                    {"timestamp", 1733000000000 + i}, {"stats", {{"volume", 4251.3}, {"price_change", 1.2},
+                    {"low", 95100.5}, {"high", 98200.0}}}, {"state", "open"}, {"settlement_price", price()},
+                    {"open_interest", 1100000000}, {"min_price", price()}, {"max_price", price()},
+                    {"mark_price", price()}, {"last_price", price()}, {"instrument_name", "BTC-PERPETUAL"},
+                    {"index_price", price()}, {"funding_8h", 3.12e-05}, {"current_funding", 0.0},
+                    {"change_id", 68000000000 + i}, {"best_bid_price", price()}, {"best_bid_amount", amount()},
+                    {"best_ask_price", price()}, {"best_ask_amount", amount()}, {"bids", bids}, {"asks", asks}
+                };
+                break;
+            }
+            default: {
+                json orders = json::array();
+                for (int o = 0; o < 100; ++o) {
+                    orders.push_back({
+                        {"web", false}, {"time_in_force", "good_til_cancelled"}, {"replaced", false},
+                        {"reduce_only", false}, {"price", price()}, {"post_only", o % 3 == 0},
+                        {"order_type", "limit"}, {"order_state", "open"}, {"order_id", fmt::format("{}", 31000000000 + o)},
+                        {"max_show", amount()}, {"last_update_timestamp", 1733000000000 + o},
+                        {"label", fmt::format("mm-quote-{}", o)}, {"is_liquidation", false}, {"instrument_name", instruments[o % 4]},
+                        {"filled_amount", 0.0}, {"direction", o % 2 ? "buy" : "sell"},
+                        {"creation_timestamp", 1733000000000 + o}, {"average_price", 0.0}, {"api", true}, {"amount", amount()}
+                    });
+                }
+                response["result"] = orders;
+                break;
+            }
+        }
+        messages.push_back(response.dump());
+    }
+    return messages;
+}
+
+struct measurement {
+    double allocations_per_message;
+    double us_per_kb;
+};
+
+int main(int argc, char** argv) {
+    vector<string> messages = argc > 1 ? load_messages(argv[1]) : synthetic_messages(30);
+    if (messages.empty()) {
+        fmt::print("No responses to measure\n");
+        return 1;
+    }
+
+    size_t bytes = 0;
+    for (auto const &message : messages) bytes += message.size();
+
+    for (auto const &message : messages) {
+        json original = json::parse(message);
+        string pretty = utils::pretty(message);
+        if (json::parse(pretty) != original || (original.dump() == message && pretty != original.dump(4))) {
+            fmt::print("utils::pretty changed a message:\n{}\n", message.substr(0, 200));
+            return 1;
+        }
+    }
+    fmt::print("{} responses, {:.1f} KB on average; utils::pretty output checked\n\n",
+               messages.size(), bytes / 1024.0 / messages.size());
+
+    // Best of five passes; allocations counted on the last one
+    auto measure = [&](auto work) {
+        double best_ns = 1e300;
+        size_t allocations = 0;
+        for (int pass = 0; pass < 5; ++pass) {
+            size_t allocations_before = g_allocations;
+            uint64_t start = now_ns();
+            for (auto const &message : messages) work(message);
+            best_ns = min(best_ns, double(now_ns() - start));
+            allocations = g_allocations - allocations_before;
+        }
+        return measurement{double(allocations) / messages.size(), best_ns / 1000.0 / (bytes / 1024.0)};
+    };
+
+    size_t sink = 0;
+    monotonic_arena arena;
+
+    measurement heap_dom = measure([&](string const &message) {
+        json parsed = json::parse(message);
+        sink += parsed.size();
+    });
+    measurement arena_dom = measure([&](string const &message) {
+        arena_scope scope(arena);
+        dom_json parsed = dom_json::parse(message);
+        sink += parsed.size();
+    });
+    measurement dump_pretty = measure([&](string const &message) {
+        sink += json::parse(message).dump(4).size();
+    });
+    measurement raw_pretty = measure([&](string const &message) {
+        sink += utils::pretty(message).size();
+    });
+
+    fmt::print("{:<28} {:>12} {:>10}\n", "Path", "allocs/msg", "us/KB");
+    fmt::print("{:<28} {:>12.1f} {:>10.2f}\n", "json::parse", heap_dom.allocations_per_message, heap_dom.us_per_kb);
+    fmt::print("{:<28} {:>12.1f} {:>10.2f}\n", "dom_json::parse (arena)", arena_dom.allocations_per_message,
+               arena_dom.us_per_kb);
+    fmt::print("{:<28} {:>12.1f} {:>10.2f}\n", "parse + dump(4)", dump_pretty.allocations_per_message,
+               dump_pretty.us_per_kb);
+    fmt::print("{:<28} {:>12.1f} {:>10.2f}\n", "utils::pretty", raw_pretty.allocations_per_message,
+               raw_pretty.us_per_kb);
+    fmt::print("\narena block after the run: {} KB ({})\n", arena.capacity() / 1024, sink > 0 ? "ok" : "empty");
+    return 0;
+}
@@ -0,0 +1,317 @@
+// Decoding book, ticker, trades and price index notifications into typed
+// updates: generic nlohmann lookups (data["price"], data.value(...)) vs
+// the schema-specialized feed decoders.
+//
+//   ./feed_decode_bench [messages-file]
+//
+// messages-file is a history spill written by `history_spill` or any file
+// with one JSON message per line, plain or gzipped; only subscription
+// notifications on the four decoded channel kinds are used. Without one,
+// a synthetic mix is generated. Both paths must produce the same updates
+// before they are timed.
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <nlohmann/json.hpp>
+#include <zlib.h>
+
+#include "market/feed_decoder.h"
+#include "utils/json_scan.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static vector<string> load_messages(const char* path) {
+    vector<string> messages;
+    gzFile file = gzopen(path, "rb");
+    if (!file) return messages;
+
+    string line;
+    char buffer[65536];
+    while (gzgets(file, buffer, sizeof(buffer))) {
+        line += buffer;
+        if (line.empty() || line.back() != '\n') continue;
+        line.pop_back();
+
+        size_t json_start = line.find('{');
+        if (json_start != string::npos && line.rfind("SENT: ", json_start) == string::npos) {
+            messages.push_back(line.substr(json_start));
+        }
+        line.clear();
+    }
+    gzclose(file);
+    return messages;
+}
+
+static vector<string> synthetic_messages(size_t count) {
+    mt19937 rng(11);
+    uniform_int_distribution<int> levels(1, 20);
+    uniform_int_distribution<int> ticks(0, 4000);
+    uniform_int_distribution<int> lots(1, 5000);
+
+    vector<string> messages;
+    int64_t timestamp = 1733000000000;
+
+    // Prices on the 0.5 tick, amounts in 10 USD lots, like BTC-PERPETUAL
+    auto price = [&]() { return 96000.0 + ticks(rng) * 0.5; };
+    auto amount = [&]() { return lots(rng) * 10.0; };
+
+    for (size_t i = 0; i < count; ++i) {
+        timestamp += 7;
+        switch (i % 4) {
+            case 0: {
+                string bids, asks;
+                for (int level = levels(rng); level > 0; --level) {
+                    bids += fmt::format("{}[\"{}\",{},{}]", bids.empty() ? "" : ",",
+                                        level % 4 == 0 ? "delete" : "change", price(), amount());
+                    asks += fmt::format("{}[\"new\",{},{}]", asks.empty() ? "" : ",", price(), amount());
+                }
+                messages.push_back(fmt::format(
+                    "{{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{{\"channel\":\"book.BTC-PERPETUAL.100ms\","
+                    "\"data\":{{\"type\":\"change\",\"timestamp\":{},\"instrument_name\":\"BTC-PERPETUAL\","
+                    "\"prev_change_id\":{},\"change_id\":{},\"bids\":[{}],\"asks\":[{}]}}}}}}",
+                    timestamp, 68000000000 + i, 68000000001 + i, bids, asks));
+                break;
+            }
+            case 1:
+                messages.push_back(fmt::format(
+                    "{{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{{\"channel\":\"ticker.BTC-PERPETUAL.100ms\","
+                    "\"data\":{{\"timestamp\":{},\"stats\":{{\"volume_usd\":410000000,\"volume\":4251.3,\"price_change\":1.2,"
+                    "\"low\":95100.5,\"high\":98200.0}},\"state\":\"open\",\"settlement_price\":96830.12,"
+                    "\"open_interest\":1100000000,\"min_price\":{},\"max_price\":{},\"mark_price\":{},"
+                    "\"last_price\":{},\"instrument_name\":\"BTC-PERPETUAL\",\"index_price\":{},"
+                    "\"funding_8h\":3.12e-05,\"current_funding\":0.0,\"best_bid_price\":{},\"best_bid_amount\":{},"
+                    "\"best_ask_price\":{},\"best_ask_amount\":{}}}}}}}",
+                    timestamp, price(), price(), price(), price(), price(), price(), amount(), price(), amount()));
+                break;
+            case 2: {
+                string trades;
+                for (int trade = levels(rng) / 5 + 1; trade > 0; --trade) {
+                    trades += fmt::format(
+                        "{}{{\"trade_seq\":{},\"trade_id\":\"{}\",\"timestamp\":{},\"tick_direction\":{},"
+                        "\"price\":{},\"mark_price\":{},\"instrument_name\":\"BTC-PERPETUAL\","
+                        "\"index_price\":{},\"direction\":\"{}\",\"amount\":{}}}",
+                        trades.empty() ? "" : ",", 200000000 + i, 300000000 + i, timestamp - trade, trade % 4,
+                        price(), price(), price(), trade % 2 ? "buy" : "sell", amount());
+                }
+                messages.push_back(fmt::format(
+                    "{{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{{\"channel\":\"trades.BTC-PERPETUAL.100ms\","
+                    "\"data\":[{}]}}}}", trades));
+                break;
+            }
+            default:
+                messages.push_back(fmt::format(
+                    "{{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{{\"channel\":\"deribit_price_index.btc_usd\","
+                    "\"data\":{{\"timestamp\":{},\"price\":{},\"index_name\":\"btc_usd\"}}}}}}",
+                    timestamp, price()));
+                break;
+        }
+    }
+    return messages;
+}
+
+// The generic path: a DOM, then lookups by key, doubles scaled afterwards
+static int64_t fixed_of(json const &data, const char* key) {
+    auto it = data.find(key);
+    return (it != data.end() && it->is_number()) ? llround(it->get<double>() * feed::FIXED_SCALE) : 0;
+}
+
+static int64_t int_of(json const &data, const char* key) {
+    auto it = data.find(key);
+    return (it != data.end() && it->is_number_integer()) ? it->get<int64_t>() : 0;
+}
+
+static void levels_of(json const &side, vector<feed::book_level> &levels) {
+    levels.clear();
+    for (auto const &entry : side) {
+        feed::book_level level;
+        string action = entry[0].get<string>();
+        level.action = action == "new" ? feed::BOOK_NEW : action == "change" ? feed::BOOK_CHANGE : feed::BOOK_DELETE;
+        level.price = llround(entry[1].get<double>() * feed::FIXED_SCALE);
+        level.amount = llround(entry[2].get<double>() * feed::FIXED_SCALE);
+        levels.push_back(level);
+    }
+}
+
+struct generic_decoder {
+    feed::book_update book{};
+    feed::ticker_update ticker{};
+    feed::trades_update trades{};
+    feed::price_index_update price_index{};
+    string instrument_name;
+
+    feed::channel_kind decode(string const &message) {
+        json parsed = json::parse(message);
+        json const &params = parsed["params"];
+        string channel = params.value("channel", "");
+        json const &data = params["data"];
+
+        if (channel.rfind("book.", 0) == 0) {
+            book.timestamp_ms = int_of(data, "timestamp");
+            book.change_id = int_of(data, "change_id");
+            book.prev_change_id = int_of(data, "prev_change_id");
+            book.snapshot = data.value("type", "") == "snapshot";
+            levels_of(data["bids"], book.bids);
+            levels_of(data["asks"], book.asks);
+            return feed::CHANNEL_BOOK;
+        }
+        if (channel.rfind("ticker.", 0) == 0) {
+            ticker.timestamp_ms = int_of(data, "timestamp");
+            ticker.best_bid_price = fixed_of(data, "best_bid_price");
+            ticker.best_bid_amount = fixed_of(data, "best_bid_amount");
+            ticker.best_ask_price = fixed_of(data, "best_ask_price");
+            ticker.best_ask_amount = fixed_of(data, "best_ask_amount");
+            ticker.last_price = fixed_of(data, "last_price");
+            ticker.mark_price = fixed_of(data, "mark_price");
+            ticker.index_price = fixed_of(data, "index_price");
+            ticker.open_interest = fixed_of(data, "open_interest");
+            ticker.funding_8h = fixed_of(data, "funding_8h");
+            instrument_name = data.value("instrument_name", "");
+            return feed::CHANNEL_TICKER;
+        }
+        if (channel.rfind("trades.", 0) == 0) {
+            trades.trades.clear();
+            for (auto const &entry : data) {
+                feed::trade t{};
+                t.timestamp_ms = int_of(entry, "timestamp");
+                t.trade_seq = int_of(entry, "trade_seq");
+                t.price = fixed_of(entry, "price");
+                t.amount = fixed_of(entry, "amount");
+                t.mark_price = fixed_of(entry, "mark_price");
+                t.index_price = fixed_of(entry, "index_price");
+                t.tick_direction = static_cast<int8_t>(int_of(entry, "tick_direction"));
+                t.buy = entry.value("direction", "") == "buy";
+                trades.trades.push_back(t);
+            }
+            return feed::CHANNEL_TRADES;
+        }
+        if (channel.rfind("deribit_price_index.", 0) == 0) {
+            price_index.timestamp_ms = int_of(data, "timestamp");
+            price_index.price = fixed_of(data, "price");
+            instrument_name = data.value("index_name", "");
+            return feed::CHANNEL_PRICE_INDEX;
+        }
+        return feed::CHANNEL_OTHER;
+    }
+};
+
+static feed::channel_kind specialized_decode(feed::decoder &decoder, string const &message) {
+    json_scan::rpc_fields fields;
+    if (!json_scan::scan_rpc(message, fields)) return feed::CHANNEL_OTHER;
+    return decoder.decode(fields.channel, fields.data);
+}
+
+static bool same_levels(vector<feed::book_level> const &a, vector<feed::book_level> const &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].price != b[i].price || a[i].amount != b[i].amount || a[i].action != b[i].action) return false;
+    }
+    return true;
+}
+
+static bool agree(feed::channel_kind kind, generic_decoder const &g, feed::decoder const &d) {
+    switch (kind) {
+        case feed::CHANNEL_BOOK:
+            return g.book.timestamp_ms == d.book().timestamp_ms && g.book.change_id == d.book().change_id &&
+                   g.book.prev_change_id == d.book().prev_change_id && g.book.snapshot == d.book().snapshot &&
+                   same_levels(g.book.bids, d.book().bids) && same_levels(g.book.asks, d.book().asks);
+        case feed::CHANNEL_TICKER:
+            return g.ticker.timestamp_ms == d.ticker().timestamp_ms &&
+                   g.ticker.best_bid_price == d.ticker().best_bid_price &&
+                   g.ticker.best_bid_amount == d.ticker().best_bid_amount &&
+                   g.ticker.best_ask_price == d.ticker().best_ask_price &&
+                   g.ticker.best_ask_amount == d.ticker().best_ask_amount &&
+                   g.ticker.last_price == d.ticker().last_price && g.ticker.mark_price == d.ticker().mark_price &&
+                   g.ticker.index_price == d.ticker().index_price &&
+                   g.ticker.open_interest == d.ticker().open_interest &&
+                   g.ticker.funding_8h == d.ticker().funding_8h &&
+                   g.instrument_name == d.ticker().instrument_name;
+        case feed::CHANNEL_TRADES: {
+            auto const &a = g.trades.trades;
+            auto const &b = d.trades().trades;
+            if (a.size() != b.size()) return false;
+            for (size_t i = 0; i < a.size(); ++i) {
+                if (a[i].timestamp_ms != b[i].timestamp_ms || a[i].trade_seq != b[i].trade_seq ||
+                    a[i].price != b[i].price || a[i].amount != b[i].amount || a[i].mark_price != b[i].mark_price ||
+                    a[i].index_price != b[i].index_price || a[i].tick_direction != b[i].tick_direction ||
+                    a[i].buy != b[i].buy) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case feed::CHANNEL_PRICE_INDEX:
+            return g.price_index.timestamp_ms == d.price_index().timestamp_ms &&
+                   g.price_index.price == d.price_index().price &&
+                   g.instrument_name == d.price_index().index_name;
+        default:
+            return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    vector<string> messages;
+    if (argc > 1) {
+        for (auto &message : load_messages(argv[1])) {
+            json_scan::rpc_fields fields;
+            if (json_scan::scan_rpc(message, fields) && fields.method == "subscription" &&
+                feed::classify_channel(fields.channel) != feed::CHANNEL_OTHER) {
+                messages.push_back(move(message));
+            }
+        }
+        if (messages.empty()) {
+            fmt::print("no book, ticker, trades or price index notifications read from {}\n", argv[1]);
+            return 1;
+        }
+    } else {
+        messages = synthetic_messages(20000);
+    }
+
+    size_t bytes = 0;
+    for (auto const &message : messages) bytes += message.size();
+    fmt::print("{} notifications, {:.0f} bytes on average{}\n\n", messages.size(), double(bytes) / messages.size(),
+               argc > 1 ? "" : " (synthetic mix)");
+
+    generic_decoder generic;
+    feed::decoder specialized;
+    for (auto const &message : messages) {
+        feed::channel_kind kind = generic.decode(message);
+        if (specialized_decode(specialized, message) != kind || !agree(kind, generic, specialized)) {
+            fmt::print("decoders disagree on:\n{}\n", message);
+            return 1;
+        }
+    }
+
+    auto time_per_message = [&](auto decode) {
+        double best = 1e18;
+        for (int pass = 0; pass < 5; ++pass) {
+            uint64_t start = now_ns();
+            for (auto const &message : messages) decode(message);
+            best = min(best, double(now_ns() - start) / messages.size());
+        }
+        return best;
+    };
+
+    double generic_ns = time_per_message([&](string const &message) { return generic.decode(message); });
+    double specialized_ns = time_per_message([&](string const &message) {
+        return specialized_decode(specialized, message);
+    });
+
+    fmt::print("{:<32} {:>10} {:>10} {:>9}\n", "Decoder", "ns/msg", "MB/s", "Speed-up");
+    fmt::print("{:<32} {:>10.0f} {:>10.0f} {:>8.1f}x\n", "nlohmann DOM + key lookups", generic_ns,
+               bytes / (generic_ns * messages.size()) * 1e3, 1.0);
+    fmt::print("{:<32} {:>10.0f} {:>10.0f} {:>8.1f}x\n",
+               fmt::format("json_scan + feed::decoder ({})", json_scan::isa_name(json_scan::active_isa())),
+               specialized_ns, bytes / (specialized_ns * messages.size()) * 1e3, generic_ns / specialized_ns);
+    return 0;
+}
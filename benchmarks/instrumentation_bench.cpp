@@ -0,0 +1,74 @@
+// Per-call cost of one start()/stop() pair at each instrumentation level.
+// All three policies are compiled into this binary regardless of the
+// DERIBIT_INSTRUMENTATION setting used for deribit_trader.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+#include <fmt/core.h>
+
+#include "latency/instrumentation.h"
+
+using namespace std;
+
+// Keeps the compiler from discarding a value that is otherwise unused
+template <typename T>
+static inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <int Level>
+static double bench_start_stop(long iterations) {
+    typedef InstrumentationPolicy<Level> Policy;
+
+    auto begin = chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        LatencyTracker::Handle handle = Policy::start(LatencyTracker::ORDER_PLACEMENT);
+        do_not_optimize(handle);
+        Policy::stop(handle);
+    }
+    auto end = chrono::steady_clock::now();
+
+    return chrono::duration<double, nano>(end - begin).count() / iterations;
+}
+
+template <int Level>
+static double bench_record(long iterations) {
+    typedef InstrumentationPolicy<Level> Policy;
+
+    auto begin = chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        Policy::record(LatencyTracker::MARKET_DATA_PROCESSING, chrono::nanoseconds(i & 0xfff));
+        do_not_optimize(i);
+    }
+    auto end = chrono::steady_clock::now();
+
+    return chrono::duration<double, nano>(end - begin).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 5000000;
+    if (iterations <= 0) iterations = 5000000;
+
+    // Pay the one-off costs (singleton, clock calibration, per-thread
+    // histogram allocation) before anything is timed.
+    getLatencyTracker();
+    bench_start_stop<DERIBIT_INSTRUMENTATION_FULL>(1000);
+    bench_record<DERIBIT_INSTRUMENTATION_FULL>(1000);
+
+    fmt::print("Clock: {}\n", getLatencyTracker().get_clock().describe());
+    fmt::print("Iterations: {}\n\n", iterations);
+    fmt::print("{:<10} {:>18} {:>14}\n", "Level", "start+stop (ns)", "record (ns)");
+    fmt::print("{:<10} {:>18.2f} {:>14.2f}\n", "OFF",
+               bench_start_stop<DERIBIT_INSTRUMENTATION_OFF>(iterations),
+               bench_record<DERIBIT_INSTRUMENTATION_OFF>(iterations));
+    fmt::print("{:<10} {:>18.2f} {:>14.2f}\n", "COUNTERS",
+               bench_start_stop<DERIBIT_INSTRUMENTATION_COUNTERS>(iterations),
+               bench_record<DERIBIT_INSTRUMENTATION_COUNTERS>(iterations));
+    fmt::print("{:<10} {:>18.2f} {:>14.2f}\n", "FULL",
+               bench_start_stop<DERIBIT_INSTRUMENTATION_FULL>(iterations),
+               bench_record<DERIBIT_INSTRUMENTATION_FULL>(iterations));
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+// Locating method, id, params.channel and the data timestamp in inbound
+// messages: nlohmann DOM vs json_scan at each instruction set the CPU has.
+//
+//   ./json_scan_bench [messages-file]
+//
+// messages-file is a history spill written by `history_spill` or any file
+// with one JSON message per line, plain or gzipped; sent messages are
+// skipped. Without one, a synthetic mix of book, ticker, trades, price
+// index, heartbeat and response messages is used. Every method must agree
+// with nlohmann on every message before it is timed.
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <nlohmann/json.hpp>
+#include <zlib.h>
+
+#include "utils/json_scan.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static vector<string> load_messages(const char* path) {
+    vector<string> messages;
+    gzFile file = gzopen(path, "rb");
+    if (!file) return messages;
+
+    string line;
+    char buffer[65536];
+    while (gzgets(file, buffer, sizeof(buffer))) {
+        line += buffer;
+        if (line.empty() || line.back() != '\n') continue;
+        line.pop_back();
+
+        size_t json_start = line.find('{');
+        if (json_start != string::npos && line.rfind("SENT: ", json_start) == string::npos) {
+            messages.push_back(line.substr(json_start));
+        }
+        line.clear();
+    }
+    gzclose(file);
+    return messages;
+}
+
+static vector<string> synthetic_messages(size_t count) {
+    mt19937 rng(7);
+    uniform_int_distribution<int> levels(1, 10);
+    uniform_real_distribution<double> prices(96000.0, 98000.0);
+    uniform_real_distribution<double> amounts(10.0, 50000.0);
+
+    vector<string> messages;
+    int64_t timestamp = 1733000000000;
+
+    for (size_t i = 0; i < count; ++i) {
+        timestamp += 7;
+        switch (i % 8) {
+            case 0: case 1: case 2: {
+                string bids, asks;
+                for (int level = levels(rng); level > 0; --level) {
+                    bids += fmt::format("{}[\"change\",{:.1f},{:.1f}]", bids.empty() ? "" : ",", prices(rng), amounts(rng));
+                    asks += fmt::format("{}[\"new\",{:.1f},{:.1f}]", asks.empty() ? "" : ",", prices(rng), amounts(rng));
+                }
+                messages.push_back(fmt::format(
+                    "{{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{{\"channel\":\"book.BTC-PERPETUAL.100ms\","
+                    "\"data\":{{\"type\":\"change\",\"timestamp\":{},\"instrument_name\":\"BTC-PERPETUAL\","
+                    "\"prev_change_id\":{},\"change_id\":{},\"bids\":[{}],\"asks\":[{}]}}}}}}",
+                    timestamp, 68000000000 + i, 68000000001 + i, bids, asks));
+                break;
+            }
+            case 3: case 4: {
+                double price = prices(rng);
+                messages.push_back(fmt::format(
+                    "{{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{{\"channel\":\"ticker.BTC-PERPETUAL.100ms\","
+                    "\"data\":{{\"timestamp\":{},\"stats\":{{\"volume_usd\":4.1e8,\"volume\":4251.3,\"price_change\":1.2,"
+                    "\"low\":95100.5,\"high\":98200.0}},\"state\":\"open\",\"settlement_price\":96830.12,"
+                    "\"open_interest\":1.1e9,\"min_price\":{:.1f},\"max_price\":{:.1f},\"mark_price\":{:.2f},"
+                    "\"last_price\":{:.1f},\"instrument_name\":\"BTC-PERPETUAL\",\"index_price\":{:.2f},"
+                    "\"funding_8h\":0.0000312,\"current_funding\":0.0,\"best_bid_price\":{:.1f},\"best_bid_amount\":{:.1f},"
+                    "\"best_ask_price\":{:.1f},\"best_ask_amount\":{:.1f}}}}}}}",
+                    timestamp, price * 0.97, price * 1.03, price, price, price, price - 0.5, amounts(rng),
+                    price + 0.5, amounts(rng)));
+                break;
+            }
+            case 5: {
+                string trades;
+                for (int trade = levels(rng) / 3 + 1; trade > 0; --trade) {
+                    trades += fmt::format(
+                        "{}{{\"trade_seq\":{},\"trade_id\":\"{}\",\"timestamp\":{},\"tick_direction\":0,"
+                        "\"price\":{:.1f},\"mark_price\":{:.2f},\"instrument_name\":\"BTC-PERPETUAL\","
+                        "\"index_price\":{:.2f},\"direction\":\"buy\",\"amount\":{:.1f}}}",
+                        trades.empty() ? "" : ",", 200000000 + i, 300000000 + i, timestamp - trade, prices(rng),
+                        prices(rng), prices(rng), amounts(rng));
+                }
+                messages.push_back(fmt::format(
+                    "{{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{{\"channel\":\"trades.BTC-PERPETUAL.100ms\","
+                    "\"data\":[{}]}}}}", trades));
+                break;
+            }
+            case 6:
+                messages.push_back(fmt::format(
+                    "{{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{{\"channel\":\"deribit_price_index.btc_usd\","
+                    "\"data\":{{\"timestamp\":{},\"price\":{:.2f},\"index_name\":\"btc_usd\"}}}}}}",
+                    timestamp, prices(rng)));
+                break;
+            default:
+                messages.push_back(i % 16 == 7
+                    ? string("{\"jsonrpc\":\"2.0\",\"method\":\"heartbeat\",\"params\":{\"type\":\"test_request\"}}")
+                    : fmt::format("{{\"jsonrpc\":\"2.0\",\"id\":{},\"result\":{{\"order\":{{\"order_id\":\"{}\","
+                                  "\"order_state\":\"open\",\"price\":{:.1f}}}}},\"usIn\":{},\"usOut\":{},\"usDiff\":42,"
+                                  "\"testnet\":true}}", 1000 + i, 9000000 + i, prices(rng), timestamp * 1000,
+                                  timestamp * 1000 + 42));
+                break;
+        }
+    }
+    return messages;
+}
+
+// What the client pulls out of each message
+struct extracted {
+    string method;
+    bool has_id = false;
+    long long id = 0;
+    string channel;
+    int64_t timestamp = -1;
+
+    bool operator==(extracted const &other) const {
+        return method == other.method && has_id == other.has_id && id == other.id &&
+               channel == other.channel && timestamp == other.timestamp;
+    }
+};
+
+static extracted with_nlohmann(string const &message) {
+    extracted e;
+    json parsed = json::parse(message);
+    e.method = parsed.value("method", "");
+    if (parsed.contains("id") && parsed["id"].is_number_integer()) {
+        e.has_id = true;
+        e.id = parsed["id"].get<long long>();
+    }
+    if (parsed.contains("params") && parsed["params"].is_object()) {
+        json const &params = parsed["params"];
+        if (params.contains("channel") && params["channel"].is_string()) e.channel = params["channel"].get<string>();
+        if (params.contains("data")) {
+            json const &data = params["data"];
+            json const &stamped = (data.is_array() && !data.empty()) ? data.back() : data;
+            if (stamped.is_object() && stamped.contains("timestamp") && stamped["timestamp"].is_number_integer()) {
+                e.timestamp = stamped["timestamp"].get<int64_t>();
+            }
+        }
+    }
+    return e;
+}
+
+static extracted with_scan(string const &message) {
+    extracted e;
+    json_scan::rpc_fields fields;
+    if (!json_scan::scan_rpc(message, fields)) return e;
+    e.method = string(fields.method);
+    e.has_id = fields.has_id;
+    e.id = fields.id;
+    e.channel = string(fields.channel);
+
+    string_view stamped = (!fields.data.empty() && fields.data.front() == '[') ? json_scan::last_element(fields.data)
+                                                                               : fields.data;
+    int64_t timestamp;
+    if (json_scan::as_int64(json_scan::find_member(stamped, "timestamp"), timestamp)) e.timestamp = timestamp;
+    return e;
+}
+
+// ns per message over a few passes, the best pass counting
+template <typename Extract>
+static double time_per_message(vector<string> const &messages, Extract extract) {
+    double best = 1e18;
+    volatile int64_t sink = 0;
+    for (int pass = 0; pass < 5; ++pass) {
+        uint64_t start = now_ns();
+        for (auto const &message : messages) {
+            extracted e = extract(message);
+            sink = sink + e.timestamp + e.id;
+        }
+        best = min(best, double(now_ns() - start) / messages.size());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    vector<string> messages;
+    if (argc > 1) {
+        messages = load_messages(argv[1]);
+        if (messages.empty()) {
+            fmt::print("no messages read from {}\n", argv[1]);
+            return 1;
+        }
+    } else {
+        messages = synthetic_messages(20000);
+    }
+
+    size_t bytes = 0;
+    for (auto const &message : messages) bytes += message.size();
+    fmt::print("{} messages, {:.0f} bytes on average{}\n\n", messages.size(), double(bytes) / messages.size(),
+               argc > 1 ? "" : " (synthetic mix)");
+
+    json_scan::isa supported = json_scan::supported_isa();
+    for (int level = json_scan::ISA_SCALAR; level <= supported; ++level) {
+        json_scan::set_isa(json_scan::isa(level));
+        for (auto const &message : messages) {
+            if (!(with_scan(message) == with_nlohmann(message))) {
+                fmt::print("json_scan ({}) disagrees with nlohmann on:\n{}\n",
+                           json_scan::isa_name(json_scan::isa(level)), message);
+                return 1;
+            }
+        }
+    }
+
+    fmt::print("{:<20} {:>10} {:>10} {:>9}\n", "Method", "ns/msg", "MB/s", "Speed-up");
+    double baseline = time_per_message(messages, with_nlohmann);
+    fmt::print("{:<20} {:>10.0f} {:>10.0f} {:>8.1f}x\n", "nlohmann::json", baseline,
+               bytes / (baseline * messages.size()) * 1e3, 1.0);
+
+    for (int level = json_scan::ISA_SCALAR; level <= supported; ++level) {
+        json_scan::set_isa(json_scan::isa(level));
+        double ns = time_per_message(messages, with_scan);
+        fmt::print("{:<20} {:>10.0f} {:>10.0f} {:>8.1f}x\n",
+                   fmt::format("json_scan {}", json_scan::isa_name(json_scan::isa(level))), ns,
+                   bytes / (ns * messages.size()) * 1e3, baseline / ns);
+    }
+    json_scan::set_isa(supported);
+    return 0;
+}
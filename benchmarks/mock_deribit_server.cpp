@@ -0,0 +1,262 @@
+// Local stand-in for the Deribit WebSocket API that drops every connection
+// on a timer, for exercising the client's reconnect supervisor:
+//
+//   ./mock_deribit_server [port] [drop_every_s] [tick_ms] [plain]
+//   deribit_trader> connect wss://localhost:9466
+//
+// It answers public/auth, public|private/subscribe, unsubscribe(_all),
+// private/get_open_orders, public/get_time, public/set_heartbeat and
+// public/test, publishes a tick on every subscribed channel each tick_ms and,
+// once heartbeats are enabled, sends a test_request every interval. The TLS
+// certificate is self-signed and generated at start-up; with `plain` it
+// serves ws:// instead, so client-side costs can be measured without TLS.
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+#include <fmt/core.h>
+#include <nlohmann/json.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include <websocketpp/config/asio.hpp>
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+
+using namespace std;
+using json = nlohmann::json;
+
+typedef websocketpp::server<websocketpp::config::asio_tls> mock_server;
+typedef websocketpp::server<websocketpp::config::asio> plain_mock_server;
+typedef shared_ptr<boost::asio::ssl::context> context_ptr;
+
+struct session {
+    set<string> channels;
+    long heartbeat_interval_ms = 0;
+    int64_t last_heartbeat_ms = 0;
+};
+
+static map<websocketpp::connection_hdl, session, owner_less<websocketpp::connection_hdl>> sessions;
+static int next_token = 1;
+
+static int64_t now_ms() {
+    return chrono::duration_cast<chrono::milliseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// PEM key and certificate for CN=localhost, valid for a day
+static bool make_self_signed(string &key_pem, string &cert_pem) {
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    if (!key_ctx || EVP_PKEY_keygen_init(key_ctx) <= 0 ||
+        EVP_PKEY_CTX_set_rsa_keygen_bits(key_ctx, 2048) <= 0 ||
+        EVP_PKEY_keygen(key_ctx, &key) <= 0) {
+        EVP_PKEY_CTX_free(key_ctx);
+        return false;
+    }
+    EVP_PKEY_CTX_free(key_ctx);
+
+    X509* cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    bool signed_ok = X509_sign(cert, key, EVP_sha256()) > 0;
+
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+    char* data;
+    long size = BIO_get_mem_data(bio, &data);
+    key_pem.assign(data, size);
+    BIO_free(bio);
+
+    bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_X509(bio, cert);
+    size = BIO_get_mem_data(bio, &data);
+    cert_pem.assign(data, size);
+    BIO_free(bio);
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return signed_ok;
+}
+
+static json respond(session &state, json const &request) {
+    json response = {{"jsonrpc", "2.0"}, {"id", request.value("id", json())}};
+    string method = request.value("method", "");
+    json params = request.value("params", json::object());
+
+    if (method == "public/auth") {
+        response["result"] = {
+            {"access_token", "mock-token-" + to_string(next_token++)},
+            {"refresh_token", "mock-refresh"},
+            {"expires_in", 900},
+            {"scope", params.value("scope", "session:mock")},
+            {"token_type", "bearer"}
+        };
+    } else if (method == "public/subscribe" || method == "private/subscribe") {
+        json channels = params.value("channels", json::array());
+        for (auto const &channel : channels) {
+            if (channel.is_string()) state.channels.insert(channel.get<string>());
+        }
+        response["result"] = channels;
+    } else if (method == "public/unsubscribe" || method == "private/unsubscribe") {
+        json channels = params.value("channels", json::array());
+        for (auto const &channel : channels) {
+            if (channel.is_string()) state.channels.erase(channel.get<string>());
+        }
+        response["result"] = channels;
+    } else if (method == "public/unsubscribe_all" || method == "private/unsubscribe_all") {
+        state.channels.clear();
+        response["result"] = "ok";
+    } else if (method == "private/get_open_orders") {
+        response["result"] = json::array({
+            {{"order_id", "MOCK-1"}, {"instrument_name", "BTC-PERPETUAL"}, {"direction", "buy"},
+             {"price", 50000.0}, {"amount", 10.0}, {"order_state", "open"}},
+            {{"order_id", "MOCK-2"}, {"instrument_name", "ETH-PERPETUAL"}, {"direction", "sell"},
+             {"price", 3000.0}, {"amount", 1.0}, {"order_state", "open"}}
+        });
+    } else if (method == "public/get_time") {
+        response["result"] = now_ms();
+    } else if (method == "public/set_heartbeat") {
+        state.heartbeat_interval_ms = params.value("interval", 0) * 1000l;
+        state.last_heartbeat_ms = now_ms();
+        response["result"] = "ok";
+    } else if (method == "public/test") {
+        response["result"] = {{"version", "mock"}};
+    } else {
+        response["error"] = {{"code", -32601}, {"message", "Method not found"}};
+    }
+    return response;
+}
+
+template <typename Server>
+static void schedule_ticks(Server &server, long tick_ms) {
+    server.set_timer(tick_ms, [&server, tick_ms](websocketpp::lib::error_code const &ec) {
+        if (ec) return;
+        static double price = 50000.0;
+        price += (rand() % 201 - 100) / 100.0;
+
+        for (auto &entry : sessions) {
+            session &state = entry.second;
+            if (state.heartbeat_interval_ms > 0 && now_ms() - state.last_heartbeat_ms >= state.heartbeat_interval_ms) {
+                json heartbeat = {
+                    {"jsonrpc", "2.0"},
+                    {"method", "heartbeat"},
+                    {"params", {{"type", "test_request"}}}
+                };
+                websocketpp::lib::error_code send_ec;
+                server.send(entry.first, heartbeat.dump(), websocketpp::frame::opcode::text, send_ec);
+                state.last_heartbeat_ms = now_ms();
+            }
+
+            for (auto const &channel : state.channels) {
+                json tick = {
+                    {"jsonrpc", "2.0"},
+                    {"method", "subscription"},
+                    {"params", {
+                        {"channel", channel},
+                        {"data", {
+                            {"index_name", channel.substr(channel.find('.') + 1)},
+                            {"price", price},
+                            {"timestamp", now_ms()}
+                        }}
+                    }}
+                };
+                websocketpp::lib::error_code send_ec;
+                server.send(entry.first, tick.dump(), websocketpp::frame::opcode::text, send_ec);
+            }
+        }
+        schedule_ticks(server, tick_ms);
+    });
+}
+
+template <typename Server>
+static void schedule_drop(Server &server, long drop_every_ms) {
+    server.set_timer(drop_every_ms, [&server, drop_every_ms](websocketpp::lib::error_code const &ec) {
+        if (ec) return;
+        if (!sessions.empty()) {
+            fmt::print("dropping {} connection(s)\n", sessions.size());
+        }
+        for (auto &entry : sessions) {
+            websocketpp::lib::error_code close_ec;
+            server.close(entry.first, websocketpp::close::status::service_restart, "mock drop", close_ec);
+        }
+        schedule_drop(server, drop_every_ms);
+    });
+}
+
+// Handlers shared by the TLS and plain servers; runs until killed
+template <typename Server>
+static void serve(Server &server, unsigned short port, long drop_every_s, long tick_ms) {
+    server.clear_access_channels(websocketpp::log::alevel::all);
+    server.clear_error_channels(websocketpp::log::elevel::all);
+    server.init_asio();
+    server.set_reuse_addr(true);
+
+    server.set_open_handler([](websocketpp::connection_hdl hdl) {
+        sessions[hdl] = session();
+        fmt::print("connection opened ({} open)\n", sessions.size());
+    });
+    server.set_close_handler([](websocketpp::connection_hdl hdl) {
+        sessions.erase(hdl);
+    });
+    server.set_message_handler([&server](websocketpp::connection_hdl hdl, typename Server::message_ptr msg) {
+        json request = json::parse(msg->get_payload(), nullptr, false);
+        if (request.is_discarded() || !request.is_object()) return;
+
+        websocketpp::lib::error_code ec;
+        server.send(hdl, respond(sessions[hdl], request).dump(), websocketpp::frame::opcode::text, ec);
+    });
+
+    server.listen(websocketpp::lib::asio::ip::tcp::v4(), port);
+    server.start_accept();
+    schedule_ticks(server, tick_ms);
+    schedule_drop(server, drop_every_s * 1000);
+    server.run();
+}
+
+int main(int argc, char** argv) {
+    unsigned short port = argc > 1 ? static_cast<unsigned short>(atoi(argv[1])) : 9466;
+    long drop_every_s = argc > 2 ? atol(argv[2]) : 10;
+    long tick_ms = argc > 3 ? atol(argv[3]) : 100;
+    bool plain = argc > 4 && string(argv[4]) == "plain";
+    if (drop_every_s <= 0) drop_every_s = 10;
+    if (tick_ms <= 0) tick_ms = 100;
+
+    fmt::print("mock Deribit on {}://localhost:{}, dropping connections every {} s, ticks every {} ms\n",
+               plain ? "ws" : "wss", port, drop_every_s, tick_ms);
+
+    if (plain) {
+        plain_mock_server server;
+        serve(server, port, drop_every_s, tick_ms);
+        return 0;
+    }
+
+    string key_pem, cert_pem;
+    if (!make_self_signed(key_pem, cert_pem)) {
+        fmt::print("cannot generate a self-signed certificate\n");
+        return 1;
+    }
+
+    mock_server server;
+    server.set_tls_init_handler([&key_pem, &cert_pem](websocketpp::connection_hdl) {
+        context_ptr context = make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_server);
+        context->use_certificate_chain(boost::asio::buffer(cert_pem));
+        context->use_private_key(boost::asio::buffer(key_pem), boost::asio::ssl::context::pem);
+        return context;
+    });
+    serve(server, port, drop_every_s, tick_ms);
+    return 0;
+}
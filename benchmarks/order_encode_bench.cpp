@@ -0,0 +1,121 @@
+// Encode time per order: building a jsonrpc object and dumping it vs
+// order_encoder's per-shape templates.
+//
+//   ./order_encode_bench [orders]
+//
+// Every encoded order is first checked byte for byte against the dumped
+// one, over random and awkward quantities and prices.
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "api/order_encoder.h"
+
+using namespace std;
+
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct order {
+    size_t shape;
+    long long id;
+    double quantity;
+    double price;
+};
+
+static vector<order_shape> make_shapes() {
+    const char* token = "1733000000000.1AbCdEfG.xYz0123456789_aBcDeFgHiJkLmNoPqRsTuVwXyZ";
+    vector<order_shape> shapes;
+    for (const char* method : {"private/buy", "private/sell"}) {
+        for (const char* instrument : {"BTC-PERPETUAL", "ETH-PERPETUAL", "BTC-27DEC24-100000-C"}) {
+            order_shape limit;
+            limit.method = method;
+            limit.instrument_name = instrument;
+            limit.access_token = token;
+            limit.type = "limit";
+            limit.label = "mm-quote \"a\"\\b";
+            limit.time_in_force = "good_til_cancelled";
+            limit.has_price = true;
+            shapes.push_back(limit);
+
+            order_shape market = limit;
+            market.type = "market";
+            market.label = "hedge";
+            market.time_in_force = "immediate_or_cancel";
+            market.contracts = true;
+            market.has_price = false;
+            shapes.push_back(market);
+        }
+    }
+    return shapes;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    if (count == 0) count = 100000;
+
+    vector<order_shape> shapes = make_shapes();
+    mt19937_64 rng(5);
+    uniform_int_distribution<int> ticks(0, 200000);
+    uniform_int_distribution<int> lots(1, 1000);
+
+    // Mostly ordinary orders, with the values whose formatting is easy to get wrong
+    const double awkward[] = {0.1, 0.3, 1e-7, 123456.789, 1e21, 5e-324, 1.7976931348623157e308, 100.0,
+                              numeric_limits<double>::infinity(), numeric_limits<double>::quiet_NaN()};
+    vector<order> orders;
+    for (size_t i = 0; i < count; ++i) {
+        order o;
+        o.shape = i % shapes.size();
+        o.id = 1733000000000ll + i;
+        o.quantity = shapes[o.shape].contracts ? lots(rng) : lots(rng) * 10.0;
+        o.price = 90000.0 + ticks(rng) * 0.5;
+        if (i % 97 == 0) o.price = awkward[(i / 97) % (sizeof(awkward) / sizeof(awkward[0]))];
+        if (i % 89 == 0 && !shapes[o.shape].contracts) o.quantity = awkward[(i / 89) % 8];
+        orders.push_back(o);
+    }
+
+    order_encoder encoder;
+    for (auto const &o : orders) {
+        order_shape const &shape = shapes[o.shape];
+        string const &encoded = encoder.encode(shape, o.id, o.quantity, o.price);
+        string dumped = order_encoder::render(shape, o.id, o.quantity, o.price);
+        if (encoded != dumped) {
+            fmt::print("mismatch:\n  dump():  {}\n  encoded: {}\n", dumped, encoded);
+            return 1;
+        }
+    }
+    fmt::print("{} orders over {} shapes byte-identical to dump()\n\n", orders.size(), encoder.template_count());
+
+    auto time_per_order = [&](auto encode) {
+        double best = 1e18;
+        size_t bytes = 0;
+        for (int pass = 0; pass < 5; ++pass) {
+            bytes = 0;
+            uint64_t start = now_ns();
+            for (auto const &o : orders) bytes += encode(o);
+            best = min(best, double(now_ns() - start) / orders.size());
+        }
+        return best;
+    };
+
+    double dump_ns = time_per_order([&](order const &o) {
+        return order_encoder::render(shapes[o.shape], o.id, o.quantity, o.price).size();
+    });
+    double template_ns = time_per_order([&](order const &o) {
+        return encoder.encode(shapes[o.shape], o.id, o.quantity, o.price).size();
+    });
+
+    fmt::print("{:<24} {:>10} {:>9}\n", "Encoder", "ns/order", "Speed-up");
+    fmt::print("{:<24} {:>10.0f} {:>8.1f}x\n", "jsonrpc + dump()", dump_ns, 1.0);
+    fmt::print("{:<24} {:>10.0f} {:>8.1f}x\n", "order_encoder", template_ns, dump_ns / template_ns);
+    return 0;
+}
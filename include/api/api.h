@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 
+#include "utils/request_id.h"
+
 using namespace std;
 
 using json = nlohmann::json;
@@ -15,18 +17,22 @@ class jsonrpc : public json {
     public:
         jsonrpc(){
             (*this)["jsonrpc"] = "2.0",
-
-            srand( time(NULL) );
-            long number = rand();
-            (*this)["id"] = number;
+            (*this)["id"] = next_id();
         }
         
         jsonrpc(const string& method){
             (*this)["jsonrpc"] = "2.0",
             (*this)["method"] = method;
-            srand( time(NULL) );
-            long number = rand();
-            (*this)["id"] = number;
+            (*this)["id"] = next_id();
+        }
+
+        // Connection the requests being built will be sent on; set by
+        // api::process. Ids come from that connection's allocator, so its
+        // response routing can index them straight into its pending ring.
+        static inline thread_local int target = 0;
+
+        static long long next_id() {
+            return request_id::next(target, request_id::CLASS_API);
         }
 };
 
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Everything about an order request except its id, quantity and price
+struct order_shape {
+    string method;              // private/buy or private/sell
+    string instrument_name;
+    string access_token;
+    string type;
+    string label;
+    string time_in_force;
+    bool contracts = false;     // quantity is contracts rather than amount
+    bool has_price = false;
+};
+
+// Encodes private/buy and private/sell requests from templates rendered
+// once per shape: the request is serialized by nlohmann once, cut at the
+// id, quantity and price values, and later orders only write those three
+// numbers between the literal pieces. Numbers are formatted the way
+// dump() formats them, so the result is byte-identical to render().
+class order_encoder {
+public:
+    // The request for shape, valid until the next call. Contracts are
+    // written as an integer; price is ignored unless shape.has_price.
+    string const &encode(order_shape const &shape, long long id, double quantity, double price);
+
+    // The same request built as a jsonrpc object and dumped
+    static string render(order_shape const &shape, long long id, double quantity, double price);
+
+    size_t template_count() const { return m_templates.size(); }
+
+    // Shapes kept; a new access token or label makes a new shape
+    static constexpr size_t MAX_TEMPLATES = 64;
+
+private:
+    // Literal text around the slots: pieces[0] id pieces[1] quantity
+    // pieces[2] [price pieces[3]]
+    struct order_template {
+        vector<string> pieces;
+        bool contracts;
+        bool has_price;
+    };
+
+    order_template const &template_for(order_shape const &shape);
+
+    map<string, order_template> m_templates;
+    string m_key;
+    string m_buffer;
+};
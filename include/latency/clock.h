@@ -0,0 +1,82 @@
+#ifndef LATENCY_CLOCK_H
+#define LATENCY_CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LATENCY_CLOCK_HAS_TSC 1
+#else
+#define LATENCY_CLOCK_HAS_TSC 0
+#endif
+
+using namespace std;
+
+// Timestamp source for LatencyTracker. Readings are opaque ticks that are
+// only meaningful as differences passed through to_nanoseconds().
+class LatencyClock {
+public:
+    enum Source {
+        STEADY, // chrono::steady_clock, ticks are nanoseconds
+        TSC     // invariant time-stamp counter, calibrated against steady_clock
+    };
+
+    LatencyClock();
+
+    // Reading taken at the start of an interval
+    uint64_t start_ticks() const {
+#if LATENCY_CLOCK_HAS_TSC
+        if (m_source.load(memory_order_acquire) == TSC) return __rdtsc();
+#endif
+        return steady_ticks();
+    }
+
+    // Reading taken at the end of an interval; rdtscp waits for the measured
+    // instructions to retire before sampling the counter.
+    uint64_t stop_ticks() const {
+#if LATENCY_CLOCK_HAS_TSC
+        if (m_source.load(memory_order_acquire) == TSC) {
+            unsigned int aux;
+            return __rdtscp(&aux);
+        }
+#endif
+        return steady_ticks();
+    }
+
+    uint64_t to_nanoseconds(uint64_t ticks) const {
+        if (m_source.load(memory_order_acquire) == TSC) {
+            return static_cast<uint64_t>(ticks * m_ns_per_tick.load(memory_order_relaxed));
+        }
+        return ticks;
+    }
+
+    Source source() const { return m_source.load(memory_order_acquire); }
+
+    // Switches the tick source, calibrating the TSC on first use. Returns
+    // false (and keeps the current source) if the CPU has no invariant TSC.
+    bool set_source(Source source);
+
+    static bool tsc_available();
+
+    // e.g. "tsc (invariant, 2.899 GHz)" or "steady_clock"
+    string describe() const;
+
+private:
+    static uint64_t steady_ticks() {
+        return chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    void calibrate_tsc();
+
+    atomic<Source> m_source;
+    // Written by calibrate_tsc() while recorder and exporter threads convert
+    atomic<double> m_ns_per_tick;
+    bool m_calibrated;
+};
+
+#endif // LATENCY_CLOCK_H
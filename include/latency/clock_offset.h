@@ -0,0 +1,47 @@
+#ifndef LATENCY_CLOCK_OFFSET_H
+#define LATENCY_CLOCK_OFFSET_H
+
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+// Estimates the offset between the exchange clock and the local wall clock
+// from request/response probes (e.g. public/get_time), NTP style: of the
+// last WINDOW probes, the one with the smallest round trip is trusted, since
+// its midpoint is the tightest bound on when the server read its clock.
+// Samples are added from one thread; the estimate can be read from any.
+class ClockOffsetEstimator {
+public:
+    static constexpr int WINDOW = 8;
+
+    ClockOffsetEstimator();
+
+    // All times are since the Unix epoch: local_send_us/local_recv_us bracket
+    // the probe, server_time_ms is the exchange's reported time.
+    void add_sample(int64_t local_send_us, int64_t server_time_ms, int64_t local_recv_us);
+
+    bool has_estimate() const { return m_has_estimate.load(memory_order_acquire); }
+
+    // Exchange clock minus local clock
+    int64_t offset_us() const { return m_offset_us.load(memory_order_relaxed); }
+
+    // Round trip of the probe the current offset came from
+    int64_t rtt_us() const { return m_rtt_us.load(memory_order_relaxed); }
+
+private:
+    struct Sample {
+        int64_t offset_us;
+        int64_t rtt_us;
+    };
+
+    Sample m_samples[WINDOW];
+    int m_sample_count;
+    int m_next_sample;
+
+    atomic<int64_t> m_offset_us;
+    atomic<int64_t> m_rtt_us;
+    atomic<bool> m_has_estimate;
+};
+
+#endif // LATENCY_CLOCK_OFFSET_H
@@ -0,0 +1,115 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+class HistogramSnapshot;
+
+// Fixed-size, log-bucketed (HDR-style) histogram of nanosecond durations.
+// Values below SUB_BUCKET_COUNT are stored exactly; above that every power of
+// two is split into SUB_BUCKET_HALF linear sub-buckets (~1.6% precision).
+// Only the owning thread may call record(); any thread may merge_into().
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 7;
+    static constexpr uint64_t SUB_BUCKET_COUNT = 1ull << SUB_BUCKET_BITS;
+    static constexpr uint64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+    static constexpr int MAX_MAGNITUDE = 42; // ~73 minutes
+    static constexpr uint64_t MAX_TRACKABLE_NS = (1ull << MAX_MAGNITUDE) - 1;
+    static constexpr size_t BUCKET_COUNT =
+        (MAX_MAGNITUDE - SUB_BUCKET_BITS) * SUB_BUCKET_HALF + SUB_BUCKET_COUNT;
+
+    static size_t bucket_index(uint64_t ns) {
+        if (ns > MAX_TRACKABLE_NS) ns = MAX_TRACKABLE_NS;
+        if (ns < SUB_BUCKET_COUNT) return ns;
+        int shift = (63 - __builtin_clzll(ns)) - (SUB_BUCKET_BITS - 1);
+        return shift * SUB_BUCKET_HALF + (ns >> shift);
+    }
+
+    static uint64_t bucket_lower_bound(size_t index) {
+        if (index < SUB_BUCKET_COUNT) return index;
+        uint64_t shift = index / SUB_BUCKET_HALF - 1;
+        return (index - shift * SUB_BUCKET_HALF) << shift;
+    }
+
+    static uint64_t bucket_upper_bound(size_t index) {
+        return bucket_lower_bound(index + 1) - 1;
+    }
+
+    LatencyHistogram() { clear(); }
+
+    // Single-writer record: plain load/store on relaxed atomics, so it is
+    // wait-free and never contends with the reader.
+    void record(uint64_t ns) {
+        bump(counts[bucket_index(ns)], 1);
+        bump(total_count, 1);
+        bump(total_sum, ns);
+        if (ns < min_value.load(memory_order_relaxed)) min_value.store(ns, memory_order_relaxed);
+        if (ns > max_value.load(memory_order_relaxed)) max_value.store(ns, memory_order_relaxed);
+    }
+
+    void clear();
+
+    bool empty() const { return total_count.load(memory_order_relaxed) == 0; }
+
+    void merge_into(HistogramSnapshot& snapshot) const;
+
+private:
+    static void bump(atomic<uint64_t>& slot, uint64_t delta) {
+        slot.store(slot.load(memory_order_relaxed) + delta, memory_order_relaxed);
+    }
+
+    atomic<uint64_t> counts[BUCKET_COUNT];
+    atomic<uint64_t> total_count;
+    atomic<uint64_t> total_sum;
+    atomic<uint64_t> min_value;
+    atomic<uint64_t> max_value;
+};
+
+// Plain (non-atomic) merged view of one or more LatencyHistograms, built by
+// the reporting thread.
+class HistogramSnapshot {
+public:
+    HistogramSnapshot();
+
+    uint64_t count() const { return total_count; }
+    uint64_t min() const { return total_count ? min_value : 0; }
+    uint64_t max() const { return max_value; }
+    uint64_t sum() const { return total_sum; }
+    double mean() const;
+
+    // Samples whose bucket lies entirely at or below ns, i.e. a cumulative
+    // count suitable for exposition with a coarser set of bucket bounds.
+    uint64_t count_at_or_below(uint64_t ns) const;
+
+    // Value at quantile q (0.0 - 1.0), interpolated linearly between the
+    // samples either side of that rank. Each sample's estimate stays within
+    // its bucket's equivalent range and within [min, max].
+    uint64_t value_at_quantile(double q) const;
+
+    // Adds count samples of ns, e.g. requests still awaiting a response.
+    void record(uint64_t ns, uint64_t count = 1);
+
+    // Copy with the samples a sender issuing one request every
+    // expected_interval_ns would have seen had it not been stalled: each
+    // sample v > interval also implies v - interval, v - 2*interval, ...
+    // down to the interval (as in HdrHistogram's copyCorrectedForCoordinatedOmission).
+    HistogramSnapshot corrected_for_coordinated_omission(uint64_t expected_interval_ns) const;
+
+private:
+    friend class LatencyHistogram;
+    friend class RollingWindow;
+
+    vector<uint64_t> counts;
+    uint64_t total_count;
+    uint64_t total_sum;
+    uint64_t min_value;
+    uint64_t max_value;
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,69 @@
+#ifndef LATENCY_INSTRUMENTATION_H
+#define LATENCY_INSTRUMENTATION_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "latency/tracker.h"
+
+using namespace std;
+
+// Instrumentation levels, selected at build time through the CMake option
+// DERIBIT_INSTRUMENTATION (OFF / COUNTERS / FULL).
+#define DERIBIT_INSTRUMENTATION_OFF 0
+#define DERIBIT_INSTRUMENTATION_COUNTERS 1
+#define DERIBIT_INSTRUMENTATION_FULL 2
+
+#ifndef DERIBIT_INSTRUMENTATION_LEVEL
+#define DERIBIT_INSTRUMENTATION_LEVEL DERIBIT_INSTRUMENTATION_FULL
+#endif
+
+// Policy through which the trading and websocket code reports latency.
+// Call sites always go through `Instrumentation`, so switching the level
+// never touches them; at OFF every call inlines to nothing.
+template <int Level>
+struct InstrumentationPolicy;
+
+template <>
+struct InstrumentationPolicy<DERIBIT_INSTRUMENTATION_OFF> {
+    static LatencyTracker::Handle start(int) { return 0; }
+    static void stop(LatencyTracker::Handle, uint64_t = 0) {}
+    static void cancel(LatencyTracker::Handle) {}
+    static void record(int, chrono::nanoseconds) {}
+    static uint64_t now() { return 0; }
+};
+
+// Counts how often each instrumented path runs, but never reads a clock
+template <>
+struct InstrumentationPolicy<DERIBIT_INSTRUMENTATION_COUNTERS> {
+    static LatencyTracker::Handle start(int series) {
+        getLatencyTracker().count_event(series);
+        return 0;
+    }
+    static void stop(LatencyTracker::Handle, uint64_t = 0) {}
+    static void cancel(LatencyTracker::Handle) {}
+    static void record(int series, chrono::nanoseconds) { getLatencyTracker().count_event(series); }
+    static uint64_t now() { return 0; }
+};
+
+template <>
+struct InstrumentationPolicy<DERIBIT_INSTRUMENTATION_FULL> {
+    static LatencyTracker::Handle start(int series) {
+        return getLatencyTracker().start_measurement(series);
+    }
+    static void stop(LatencyTracker::Handle handle, uint64_t end_ticks = 0) {
+        getLatencyTracker().stop_measurement(handle, end_ticks);
+    }
+    static void cancel(LatencyTracker::Handle handle) {
+        getLatencyTracker().cancel_measurement(handle);
+    }
+    static void record(int series, chrono::nanoseconds duration) {
+        getLatencyTracker().record(series, duration);
+    }
+    // Clock reading to pass to stop() later as end_ticks
+    static uint64_t now() { return getLatencyTracker().get_clock().stop_ticks(); }
+};
+
+typedef InstrumentationPolicy<DERIBIT_INSTRUMENTATION_LEVEL> Instrumentation;
+
+#endif // LATENCY_INSTRUMENTATION_H
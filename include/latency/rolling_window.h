@@ -0,0 +1,54 @@
+#ifndef LATENCY_ROLLING_WINDOW_H
+#define LATENCY_ROLLING_WINDOW_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "latency/histogram.h"
+
+using namespace std;
+
+// Sliding-window latency histogram: a ring of SLOT_COUNT time slices, each
+// SLICE_SECONDS wide, using the same buckets as LatencyHistogram so a window
+// merges straight into a HistogramSnapshot. Like LatencyHistogram, only the
+// owning thread may call record(), which is wait-free; any thread may
+// merge_into(), typically summing every thread's window at report time.
+class RollingWindow {
+public:
+    static constexpr int SLICE_SECONDS = 5;
+    // Five minutes of complete slices plus the one being filled
+    static constexpr int SLOT_COUNT = 5 * 60 / SLICE_SECONDS + 1;
+    static constexpr int MAX_WINDOW_SECONDS = (SLOT_COUNT - 1) * SLICE_SECONDS;
+
+    RollingWindow();
+
+    // Coarse monotonic time in ns; cheap enough to call on every sample
+    static uint64_t now_ns();
+
+    void record(uint64_t ns, uint64_t now = now_ns());
+
+    // Merges the slices covering the last `seconds` (rounded to whole slices,
+    // the newest of which is still filling) into snapshot.
+    void merge_into(HistogramSnapshot& snapshot, int seconds, uint64_t now = now_ns()) const;
+
+    // Forgets every slice; their counts are zeroed as they are reused, so
+    // this is cheap enough for the owner to call on its recording path.
+    void clear();
+
+private:
+    // A slice is tagged with its index since the clock's epoch plus one, so 0
+    // means unused. The top bit is set while the owner is recycling it.
+    struct Slice {
+        atomic<uint64_t> id;
+        atomic<uint32_t> counts[LatencyHistogram::BUCKET_COUNT];
+        atomic<uint64_t> total_sum;
+        atomic<uint64_t> max_value;
+    };
+
+    Slice* claim(uint64_t id);
+
+    Slice m_slices[SLOT_COUNT];
+};
+
+#endif // LATENCY_ROLLING_WINDOW_H
@@ -0,0 +1,108 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "latency/tracker.h"
+#include "latency/instrumentation.h"
+
+using namespace std;
+
+// Scoped-span tracer for message handling stages. Spans go into fixed-size
+// per-thread ring buffers and can be dumped as Chrome trace-event JSON,
+// which loads directly in Perfetto / chrome://tracing.
+class Tracer {
+public:
+    static constexpr int MAX_TRACE_THREADS = 32;
+    // Per-thread ring size (power of two); older spans are overwritten
+    static constexpr size_t EVENTS_PER_THREAD = 16384;
+
+    // Checked by every ScopedSpan; the only cost of a span while disabled
+    inline static atomic<bool> enabled{false};
+
+    Tracer();
+    ~Tracer();
+
+    Tracer(const Tracer&) = delete;
+    void operator=(const Tracer&) = delete;
+
+    // Starting discards spans from any earlier session
+    void start();
+    void stop();
+
+    // name must outlive the tracer (string literals)
+    void record(const char* name, uint64_t start_ticks, uint64_t end_ticks);
+
+    // Labels the calling thread in dumps; name must be a string literal
+    void set_thread_name(const char* name);
+
+    // Writes the spans recorded since start() to path. Returns the number
+    // of spans written, or -1 with error set.
+    long dump(const string& path, string& error);
+
+private:
+    struct Event {
+        atomic<const char*> name{nullptr};
+        atomic<uint64_t> start_ticks{0};
+        atomic<uint64_t> end_ticks{0};
+    };
+
+    // Written only by its owning thread; head counts every span ever recorded
+    struct ThreadBuffer {
+        int tid;
+        atomic<const char*> name{nullptr};
+        atomic<uint64_t> head{0};
+        Event events[EVENTS_PER_THREAD];
+    };
+
+    ThreadBuffer* local_buffer();
+
+    atomic<ThreadBuffer*> m_buffers[MAX_TRACE_THREADS];
+    atomic<int> m_buffer_count;
+    atomic<uint64_t> m_session_start_ticks;
+};
+
+// Global singleton accessor
+Tracer& getTracer();
+
+// Tracer::enabled is read once, in the constructor; the destructor only
+// tests the decision stored in the span, so a span opened while tracing is
+// on is still recorded if tracing stops before it closes.
+class ScopedSpan {
+public:
+    explicit ScopedSpan(const char* name) :
+        m_name(name),
+        m_active(__builtin_expect(Tracer::enabled.load(memory_order_relaxed), 0))
+    {
+        if (__builtin_expect(m_active, 0)) {
+            m_start_ticks = getLatencyTracker().get_clock().start_ticks();
+        }
+    }
+
+    ~ScopedSpan() {
+        if (__builtin_expect(m_active, 0)) {
+            getTracer().record(m_name, m_start_ticks, getLatencyTracker().get_clock().stop_ticks());
+        }
+    }
+
+    ScopedSpan(const ScopedSpan&) = delete;
+    void operator=(const ScopedSpan&) = delete;
+
+private:
+    const char* m_name;
+    bool m_active;
+    // Only read when m_active
+    uint64_t m_start_ticks;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#if DERIBIT_INSTRUMENTATION_LEVEL >= DERIBIT_INSTRUMENTATION_FULL
+#define TRACE_SPAN(name) ScopedSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) do {} while (0)
+#endif
+
+#endif // LATENCY_TRACE_H
@@ -1,6 +1,7 @@
 #ifndef LATENCY_TRACKER_H
 #define LATENCY_TRACKER_H
 
+#include <atomic>
 #include <chrono>
 #include <map>
 #include <vector>
@@ -11,6 +12,10 @@
 #include <numeric>
 #include <iomanip>
 
+#include "latency/clock.h"
+#include "latency/histogram.h"
+#include "latency/rolling_window.h"
+
 using namespace std;
 
 class LatencyTracker {
@@ -19,34 +24,152 @@ public:
         ORDER_PLACEMENT,
         MARKET_DATA_PROCESSING,
         WEBSOCKET_MESSAGE_PROPAGATION,
-        TRADING_LOOP_END_TO_END
+        TRADING_LOOP_END_TO_END,
+        REQUEST_ROUND_TRIP,
+        FEED_LATENCY,
+        RECONNECT_TO_FIRST_TICK,
+        HEARTBEAT_RTT,
+        CONNECTION_SETUP,
+        LATENCY_TYPE_COUNT
     };
 
-    struct LatencyMetric {
-        chrono::high_resolution_clock::time_point start_time;
-        chrono::high_resolution_clock::time_point end_time;
-        chrono::nanoseconds duration{0};
-        bool completed{false};
-    };
+    // Histograms are addressed by series id. Ids below LATENCY_TYPE_COUNT are
+    // the LatencyTypes themselves; register_series() adds labelled sub-series
+    // (e.g. one per JSON-RPC method) whose samples also count towards their
+    // parent type.
+    static constexpr int MAX_SERIES = 64;
+
+    // Upper bound on threads recording at once. A thread's recorder is handed
+    // to the next new thread when it exits; samples from threads beyond the
+    // bound are counted as dropped instead of allocating more storage.
+    static constexpr int MAX_RECORDER_THREADS = 32;
+
+    // Opaque token returned by start_measurement(); 0 is never a valid handle.
+    typedef uint64_t Handle;
+
+    // Size of the in-flight measurement table (power of two). A handle that
+    // is not stopped before the table wraps around is silently discarded.
+    static constexpr size_t MAX_PENDING_MEASUREMENTS = 4096;
+
+    LatencyTracker();
+    ~LatencyTracker();
+
+    LatencyTracker(const LatencyTracker&) = delete;
+    void operator=(const LatencyTracker&) = delete;
+
+    // Returns the id of the series labelled `label` under `type`, creating it
+    // on first use, or `type` itself once MAX_SERIES is exhausted.
+    int register_series(LatencyType type, const string& label);
 
-    void start_measurement(LatencyType type, const string& unique_id = "");
+    Handle start_measurement(int series);
 
-    void stop_measurement(LatencyType type, const string& unique_id = "");
+    // Stops the measurement identified by handle; may be called from any
+    // thread. end_ticks lets the caller pass a clock reading taken earlier,
+    // e.g. when the frame arrived rather than after it was parsed.
+    void stop_measurement(Handle handle, uint64_t end_ticks = 0);
+
+    // Releases a measurement that will never complete (e.g. its connection
+    // closed) without recording anything.
+    void cancel_measurement(Handle handle);
+
+    // Records an already measured duration into the calling thread's histogram.
+    void record(int series, chrono::nanoseconds duration);
+
+    // Counts an event without timing it (counter-only instrumentation)
+    void count_event(int series);
+
+    uint64_t get_event_count(int series);
 
     string generate_report();
 
-    map<LatencyType, vector<LatencyMetric>> get_raw_metrics();
+    // Side-by-side view of the last 10s / 1m / 5m for each LatencyType
+    string generate_window_report();
+
+    // Prometheus text exposition of every series: cumulative buckets in
+    // seconds, _sum and _count. Lock-free, so safe to call from a scraper.
+    void write_openmetrics(ostream& out);
+
+    // Merges every thread's histogram for the given series.
+    HistogramSnapshot get_snapshot(int series);
+
+    // Samples of a LatencyType recorded within the last `seconds` (at most
+    // RollingWindow::MAX_WINDOW_SECONDS).
+    HistogramSnapshot get_window_snapshot(LatencyType type, int seconds);
+
+    // Interval at which a steady sender would issue requests of this type;
+    // when non-zero the report adds a coordinated-omission corrected view
+    // that also counts measurements still in flight. 0 disables it.
+    void set_expected_interval(LatencyType type, chrono::nanoseconds interval);
+    chrono::nanoseconds get_expected_interval(LatencyType type) const;
+
+    // Snapshot of a type corrected for its expected interval, plus the
+    // current age of every measurement of that type still in flight
+    // (returned through `in_flight`).
+    HistogramSnapshot get_corrected_snapshot(LatencyType type, uint64_t& in_flight);
 
     void reset();
 
+    // Switches the timestamp source; measurements in flight are discarded
+    // since their start ticks are in the old clock's units.
+    bool set_clock_source(LatencyClock::Source source);
+
+    const LatencyClock& get_clock() const { return clock; }
+
 private:
-    // Thread-safe collections for storing latency metrics
-    mutex metrics_mutex;
-    map<LatencyType, vector<LatencyMetric>> latency_metrics;
-    map<string, LatencyMetric> active_measurements;
+    // Per-thread storage, written only by its owning thread and merged by
+    // the report and exposition paths. Everything is allocated when a thread
+    // claims the recorder, so recording never allocates or shares a cache
+    // line with another thread.
+    struct ThreadRecorder {
+        atomic<uint32_t> epoch{0};
+        // Cleared when the owning thread exits
+        atomic<bool> in_use{true};
+        LatencyHistogram histograms[MAX_SERIES];
+        RollingWindow windows[LATENCY_TYPE_COUNT];
+        atomic<uint64_t> event_counts[MAX_SERIES] = {};
+    };
+
+    // Registered sub-series. Entries are immutable once series_count has
+    // been bumped past them, so readers never need registry_mutex.
+    struct SeriesInfo {
+        LatencyType parent;
+        string label;
+    };
+
+    // One in-flight measurement. handle is 0 while the slot is free.
+    struct PendingSlot {
+        atomic<uint64_t> handle{0};
+        atomic<uint64_t> start_ticks{0};
+        atomic<int> series{0};
+    };
+
+    ThreadRecorder* local_recorder();
+    ThreadRecorder* claim_recorder();
+
+    // local_recorder(), cleared first if a reset happened since it last recorded
+    ThreadRecorder* current_recorder();
+
+    void record_one(ThreadRecorder* recorder, int series, uint64_t ns);
+
+    atomic<ThreadRecorder*> recorders[MAX_RECORDER_THREADS];
+    atomic<int> recorder_count;
+    // Bumped by reset(); recorders lazily clear themselves when they notice.
+    atomic<uint32_t> reset_epoch;
+    atomic<uint64_t> dropped_samples;
+
+    atomic<uint64_t> expected_interval_ns[LATENCY_TYPE_COUNT];
+
+    LatencyClock clock;
+
+    mutex registry_mutex;
+    SeriesInfo series_info[MAX_SERIES];
+    atomic<int> series_count;
+
+    atomic<uint64_t> next_handle;
+    PendingSlot pending[MAX_PENDING_MEASUREMENTS];
 };
 
 // Global singleton accessor
 LatencyTracker& getLatencyTracker();
 
-#endif // LATENCY_TRACKER_H
\ No newline at end of file
+#endif // LATENCY_TRACKER_H
@@ -0,0 +1,141 @@
+#ifndef MARKET_FEED_DECODER_H
+#define MARKET_FEED_DECODER_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Decoders for the subscription channels with a fixed shape. Each writes
+// params.data straight into a struct, located with json_scan, with prices
+// and amounts as fixed-point integers; no DOM, no string keys hashed at
+// run time, and no allocation once the book vectors have grown.
+//
+// string_view fields point into the frame and are valid while it is.
+namespace feed {
+
+    // Prices and amounts are value * FIXED_SCALE
+    constexpr int FIXED_DECIMALS = 8;
+    constexpr int64_t FIXED_SCALE = 100000000;
+
+    // Parses a JSON number (exponents included) into fixed point, rounding
+    // beyond FIXED_DECIMALS. False on anything else, null included, or
+    // if the value does not fit.
+    bool parse_fixed(string_view text, int64_t &out);
+    inline double to_double(int64_t fixed) { return double(fixed) / FIXED_SCALE; }
+
+    enum channel_kind : uint8_t {
+        CHANNEL_TICKER,
+        CHANNEL_TRADES,
+        CHANNEL_PRICE_INDEX,
+        CHANNEL_BOOK,
+        CHANNEL_OTHER
+    };
+
+    // From the channel name's first segment ("book" in
+    // "book.BTC-PERPETUAL.100ms"), by a perfect hash over the four known ones
+    channel_kind classify_channel(string_view channel);
+    const char* channel_kind_name(channel_kind kind);
+
+    enum book_action : uint8_t {
+        BOOK_NEW,
+        BOOK_CHANGE,
+        BOOK_DELETE,
+        BOOK_LEVEL      // grouped books carry no action
+    };
+
+#pragma pack(push, 1)
+    struct book_level {
+        int64_t price;
+        int64_t amount;
+        book_action action;
+    };
+#pragma pack(pop)
+
+    struct book_update {
+        string_view instrument_name;
+        int64_t timestamp_ms;
+        int64_t change_id;
+        int64_t prev_change_id;     // 0 on snapshots and grouped books
+        bool snapshot;
+        vector<book_level> bids;
+        vector<book_level> asks;
+    };
+
+    struct ticker_update {
+        string_view instrument_name;
+        int64_t timestamp_ms;
+        int64_t best_bid_price;
+        int64_t best_bid_amount;
+        int64_t best_ask_price;
+        int64_t best_ask_amount;
+        int64_t last_price;
+        int64_t mark_price;
+        int64_t index_price;
+        int64_t open_interest;
+        int64_t min_price;
+        int64_t max_price;
+        int64_t current_funding;
+        int64_t funding_8h;
+        string_view state;
+    };
+
+#pragma pack(push, 1)
+    struct trade {
+        int64_t timestamp_ms;
+        int64_t trade_seq;
+        int64_t price;
+        int64_t amount;
+        int64_t mark_price;
+        int64_t index_price;
+        int8_t tick_direction;
+        bool buy;
+    };
+#pragma pack(pop)
+
+    struct trades_update {
+        string_view instrument_name;    // of the first trade
+        vector<trade> trades;
+    };
+
+    struct price_index_update {
+        string_view index_name;
+        int64_t timestamp_ms;
+        int64_t price;
+    };
+
+    // Schema-specialized decoders; false if data does not have the shape.
+    // Fields absent from data are left 0.
+    bool decode(string_view data, book_update &out);
+    bool decode(string_view data, ticker_update &out);
+    bool decode(string_view data, trades_update &out);
+    bool decode(string_view data, price_index_update &out);
+
+    // Keeps one update of each kind, reused frame after frame
+    class decoder {
+    public:
+        // Dispatches on the channel once and decodes data into the
+        // matching update; CHANNEL_OTHER if the channel is not one of the
+        // four or data did not decode
+        channel_kind decode(string_view channel, string_view data);
+
+        // Exchange time of the last frame decoded (its newest trade, for
+        // trades), or -1
+        int64_t timestamp_ms() const { return m_timestamp_ms; }
+
+        book_update const &book() const { return m_book; }
+        ticker_update const &ticker() const { return m_ticker; }
+        trades_update const &trades() const { return m_trades; }
+        price_index_update const &price_index() const { return m_price_index; }
+
+    private:
+        int64_t m_timestamp_ms = -1;
+        book_update m_book{};
+        ticker_update m_ticker{};
+        trades_update m_trades{};
+        price_index_update m_price_index{};
+    };
+}
+
+#endif // MARKET_FEED_DECODER_H
@@ -0,0 +1,53 @@
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+using namespace std;
+
+// Minimal HTTP listener that serves Prometheus text exposition on
+// 127.0.0.1:<port>. Every request, whatever its path, gets the output of
+// all registered collectors. Runs on its own thread; collectors must only
+// read state that is safe to access without the message path's locks.
+class MetricsExporter {
+public:
+    typedef function<void(ostream&)> collector;
+
+    static constexpr unsigned short DEFAULT_PORT = 9464;
+
+    MetricsExporter();
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    void operator=(const MetricsExporter&) = delete;
+
+    // Collectors must be added before start()
+    void add_collector(collector c);
+
+    bool start(unsigned short port, string& error);
+    void stop();
+    bool is_running() const { return m_thread.joinable(); }
+    unsigned short get_port() const { return m_port; }
+
+    // Runs every collector into a single exposition document
+    string render();
+
+private:
+    void accept_next();
+    void serve(shared_ptr<boost::asio::ip::tcp::socket> socket);
+
+    boost::asio::io_context m_io;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    thread m_thread;
+    vector<collector> m_collectors;
+    unsigned short m_port;
+};
+
+#endif // METRICS_EXPORTER_H
@@ -0,0 +1,162 @@
+#ifndef UTILS_ARENA_H
+#define UTILS_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// Bump allocator for short-lived object graphs, such as the DOM of one
+// received message. Nothing is freed individually; reset() drops it all at
+// once. After a reset the blocks are merged into one as large as their sum,
+// so a steady stream of similar messages settles into a single block and
+// stops touching the heap. Past MAX_RETAINED_SIZE the blocks are released
+// instead, so one outsized message doesn't pin its memory for good.
+class monotonic_arena {
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 << 10;
+    static constexpr size_t MAX_RETAINED_SIZE = 4 << 20;
+
+    explicit monotonic_arena(size_t block_size = DEFAULT_BLOCK_SIZE) :
+        m_block_size(block_size),
+        m_cursor(nullptr),
+        m_end(nullptr),
+        m_used(0)
+    {}
+
+    monotonic_arena(const monotonic_arena&) = delete;
+    void operator=(const monotonic_arena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment) {
+        uintptr_t start = (reinterpret_cast<uintptr_t>(m_cursor) + alignment - 1) & ~uintptr_t(alignment - 1);
+        if (!m_cursor || start + bytes > reinterpret_cast<uintptr_t>(m_end)) {
+            add_block(bytes + alignment);
+            start = (reinterpret_cast<uintptr_t>(m_cursor) + alignment - 1) & ~uintptr_t(alignment - 1);
+        }
+        m_used += start + bytes - reinterpret_cast<uintptr_t>(m_cursor);
+        m_cursor = reinterpret_cast<char*>(start + bytes);
+        return reinterpret_cast<void*>(start);
+    }
+
+    void reset() {
+        size_t total = capacity();
+        if (total > MAX_RETAINED_SIZE) {
+            m_blocks.clear();
+        } else if (m_blocks.size() > 1) {
+            m_blocks.clear();
+            m_blocks.push_back({unique_ptr<char[]>(new char[total]), total});
+        }
+        m_cursor = m_blocks.empty() ? nullptr : m_blocks.back().data.get();
+        m_end = m_blocks.empty() ? nullptr : m_cursor + m_blocks.back().size;
+        m_used = 0;
+    }
+
+    // Bytes handed out since the last reset, and held in blocks
+    size_t used() const { return m_used; }
+    size_t capacity() const {
+        size_t total = 0;
+        for (auto const &block : m_blocks) total += block.size;
+        return total;
+    }
+
+    // The arena arena_allocator draws from on this thread, if any
+    static monotonic_arena* current() { return t_current; }
+
+private:
+    struct block {
+        unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    void add_block(size_t at_least) {
+        size_t size = m_blocks.empty() ? m_block_size : m_blocks.back().size * 2;
+        if (size < at_least) size = at_least;
+        m_blocks.push_back({unique_ptr<char[]>(new char[size]), size});
+        m_cursor = m_blocks.back().data.get();
+        m_end = m_cursor + size;
+    }
+
+    size_t m_block_size;
+    vector<block> m_blocks;
+    char* m_cursor;
+    char* m_end;
+    size_t m_used;
+
+    static inline thread_local monotonic_arena* t_current = nullptr;
+
+    friend class arena_scope;
+};
+
+// Makes arena the current one on this thread until the scope ends, then
+// resets it. Everything allocated from it must be gone by then; heap
+// allocations made outside the scope may be freed inside it and vice versa.
+class arena_scope {
+public:
+    explicit arena_scope(monotonic_arena &arena) : m_arena(arena), m_previous(monotonic_arena::t_current) {
+        monotonic_arena::t_current = &arena;
+    }
+
+    ~arena_scope() {
+        monotonic_arena::t_current = m_previous;
+        m_arena.reset();
+    }
+
+    arena_scope(const arena_scope&) = delete;
+    void operator=(const arena_scope&) = delete;
+
+private:
+    monotonic_arena &m_arena;
+    monotonic_arena* m_previous;
+};
+
+// Allocator over the thread's current arena, falling back to the heap
+// outside any arena_scope. Each allocation is prefixed with the arena it
+// came from (null for the heap), since nlohmann default-constructs an
+// allocator to free a node and so can't be handed the one that made it;
+// any instance can therefore free memory from any other.
+template <typename T>
+struct arena_allocator {
+    typedef T value_type;
+    typedef true_type is_always_equal;
+
+    arena_allocator() = default;
+    template <typename U> arena_allocator(arena_allocator<U> const &) {}
+
+    T* allocate(size_t n) {
+        if (n > (SIZE_MAX - header_size()) / sizeof(T)) throw bad_alloc();
+        size_t bytes = header_size() + n * sizeof(T);
+        size_t alignment = alignof(T) > alignof(monotonic_arena*) ? alignof(T) : alignof(monotonic_arena*);
+
+        monotonic_arena* origin = monotonic_arena::current();
+        char* raw = static_cast<char*>(origin ? origin->allocate(bytes, alignment) : ::operator new(bytes));
+        memcpy(raw, &origin, sizeof(origin));
+        return reinterpret_cast<T*>(raw + header_size());
+    }
+
+    void deallocate(T* p, size_t) noexcept {
+        char* raw = reinterpret_cast<char*>(p) - header_size();
+        monotonic_arena* origin;
+        memcpy(&origin, raw, sizeof(origin));
+        if (!origin) ::operator delete(raw);
+    }
+
+private:
+    // Origin tag, padded so that the T that follows stays aligned. A
+    // function rather than a constant, as T may still be incomplete here.
+    static constexpr size_t header_size() {
+        static_assert(alignof(T) <= alignof(max_align_t), "arena_allocator does not support over-aligned types");
+        return (sizeof(monotonic_arena*) + alignof(T) - 1) / alignof(T) * alignof(T);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(arena_allocator<T> const &, arena_allocator<U> const &) { return true; }
+template <typename T, typename U>
+bool operator!=(arena_allocator<T> const &, arena_allocator<U> const &) { return false; }
+
+#endif // UTILS_ARENA_H
@@ -0,0 +1,21 @@
+#ifndef UTILS_ARENA_JSON_H
+#define UTILS_ARENA_JSON_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "utils/arena.h"
+
+using namespace std;
+
+// nlohmann DOM whose nodes, strings and containers come from the current
+// arena (see arena_scope), so parsing a message costs no heap allocations
+// once the arena has grown to fit. Converts to and from json by copy.
+typedef basic_string<char, char_traits<char>, arena_allocator<char>> arena_string;
+typedef nlohmann::basic_json<map, vector, arena_string, bool, int64_t, uint64_t, double, arena_allocator> dom_json;
+
+#endif // UTILS_ARENA_JSON_H
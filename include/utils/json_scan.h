@@ -0,0 +1,82 @@
+#ifndef UTILS_JSON_SCAN_H
+#define UTILS_JSON_SCAN_H
+
+#include <cstdint>
+#include <string_view>
+
+using namespace std;
+
+// On-demand reader for inbound JSON-RPC messages: finds where a handful of
+// fields sit in the text without building a DOM. The scan for the next
+// quote, backslash or bracket runs 32 (AVX2) or 16 (SSE4.2) bytes at a time,
+// picked at start-up from what the CPU supports, with a scalar fallback.
+//
+// Views point into the scanned text. Strings come without their quotes and
+// still escaped; other values are their raw text, brackets included. Absent
+// fields are empty views. Only the structure is checked, not that the
+// text is otherwise valid JSON.
+namespace json_scan {
+
+    enum isa {
+        ISA_SCALAR,
+        ISA_SSE42,
+        ISA_AVX2
+    };
+
+    struct rpc_fields {
+        string_view method;
+        bool has_id = false;
+        long long id = 0;
+        string_view params;
+        string_view channel;    // params.channel
+        string_view data;       // params.data
+        string_view result;
+        string_view error;
+    };
+
+    // False unless text is a well-formed JSON object
+    bool scan_rpc(string_view text, rpc_fields &fields);
+
+    // Value of key in an object, or of the last element of an array
+    string_view find_member(string_view object, string_view key);
+    string_view last_element(string_view array);
+
+    // Walk an object's members or an array's elements in order:
+    //   json_scan::members m(object);
+    //   while (m.next(key, value)) ...
+    // next() is false at the end, and on malformed input.
+    class members {
+    public:
+        explicit members(string_view object);
+        bool next(string_view &key, string_view &value);
+
+    private:
+        const char* m_p;
+        const char* m_end;
+    };
+
+    class elements {
+    public:
+        explicit elements(string_view array);
+        bool next(string_view &value);
+
+    private:
+        const char* m_p;
+        const char* m_end;
+    };
+
+    // The contents of a string value; empty if value is not a string
+    string_view as_string(string_view value);
+    // False unless value is an integer that fits
+    bool as_int64(string_view value, int64_t &out);
+
+    // Best instruction set the CPU supports, and the one in use. set_isa()
+    // is for benchmarks, before any scanning starts; it is capped at
+    // what is supported.
+    isa supported_isa();
+    isa active_isa();
+    void set_isa(isa level);
+    const char* isa_name(isa level);
+}
+
+#endif // UTILS_JSON_SCAN_H
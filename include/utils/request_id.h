@@ -0,0 +1,80 @@
+#ifndef UTILS_REQUEST_ID_H
+#define UTILS_REQUEST_ID_H
+
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+// JSON-RPC request ids, allocated per connection. An id packs
+//
+//   [connection:8][class:4][sequence:41]
+//
+// into 53 bits, so it survives a peer that reads numbers as doubles. The
+// sequence is a single counter per connection shared by every class, so the
+// low bits of the ids in flight on a connection differ and can index a ring
+// of pending requests directly. Class 0 is never allocated: ids below
+// 1 << 41 were typed by hand or made elsewhere.
+namespace request_id {
+
+    enum id_class {
+        CLASS_FOREIGN,
+        CLASS_API,              // requests built by api:: and the stream command
+        CLASS_RESTORE,          // re-authorize, re-subscribe and resync after a reconnect
+        CLASS_HEARTBEAT,        // public/set_heartbeat and public/test
+        CLASS_CLOCK_PROBE       // public/get_time
+    };
+
+    constexpr int SEQUENCE_BITS = 41;
+    constexpr int CLASS_BITS = 4;
+    constexpr int CONNECTION_BITS = 8;
+    constexpr int MAX_CONNECTIONS = 1 << CONNECTION_BITS;
+    constexpr uint64_t SEQUENCE_MASK = (1ull << SEQUENCE_BITS) - 1;
+
+    constexpr long long make(int connection, id_class cls, uint64_t sequence) {
+        return static_cast<long long>(
+            (uint64_t(connection & (MAX_CONNECTIONS - 1)) << (SEQUENCE_BITS + CLASS_BITS)) |
+            (uint64_t(cls) << SEQUENCE_BITS) |
+            (sequence & SEQUENCE_MASK));
+    }
+
+    constexpr int connection_of(long long id) {
+        return int((uint64_t(id) >> (SEQUENCE_BITS + CLASS_BITS)) & (MAX_CONNECTIONS - 1));
+    }
+
+    constexpr id_class class_of(long long id) {
+        return id < 0 ? CLASS_FOREIGN : id_class((uint64_t(id) >> SEQUENCE_BITS) & ((1 << CLASS_BITS) - 1));
+    }
+
+    constexpr uint64_t sequence_of(long long id) { return uint64_t(id) & SEQUENCE_MASK; }
+
+    static_assert(SEQUENCE_BITS + CLASS_BITS + CONNECTION_BITS == 53, "ids must fit a double's mantissa");
+    static_assert(class_of(make(MAX_CONNECTIONS - 1, CLASS_CLOCK_PROBE, SEQUENCE_MASK)) == CLASS_CLOCK_PROBE,
+                  "fields must not overlap");
+
+    // Lock-free: any thread may allocate. Sequences start at 1 and wrap
+    // after 2^41 ids, long after any request could still be in flight.
+    class allocator {
+    public:
+        long long next(int connection, id_class cls) {
+            return make(connection, cls, m_next.fetch_add(1, memory_order_relaxed));
+        }
+
+    private:
+        // Each on its own cache line, as connections allocate from different threads
+        alignas(64) atomic<uint64_t> m_next{1};
+    };
+
+    // The allocator of a connection. Connections MAX_CONNECTIONS apart
+    // share one, which keeps their ids apart as well.
+    inline allocator &for_connection(int connection) {
+        static allocator allocators[MAX_CONNECTIONS];
+        return allocators[connection & (MAX_CONNECTIONS - 1)];
+    }
+
+    inline long long next(int connection, id_class cls) {
+        return for_connection(connection).next(connection, cls);
+    }
+}
+
+#endif // UTILS_REQUEST_ID_H
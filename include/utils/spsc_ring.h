@@ -0,0 +1,105 @@
+#ifndef UTILS_SPSC_RING_H
+#define UTILS_SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+using namespace std;
+
+// Bounded lock-free single-producer/single-consumer queue. push() never
+// blocks: when the ring is full the item is refused and counted as dropped,
+// so a slow consumer can't back-pressure the producer. Capacity is rounded
+// up to a power of two.
+template <typename T>
+class spsc_ring {
+public:
+    explicit spsc_ring(size_t capacity) :
+        m_capacity(round_up(capacity)),
+        m_mask(m_capacity - 1),
+        m_slots(new T[m_capacity]),
+        m_head(0),
+        m_tail(0),
+        m_cached_head(0),
+        m_cached_tail(0),
+        m_high_water(0),
+        m_dropped(0)
+    {}
+
+    spsc_ring(const spsc_ring&) = delete;
+    void operator=(const spsc_ring&) = delete;
+
+    // Producer only
+    bool push(T&& item) {
+        size_t tail = m_tail.load(memory_order_relaxed);
+        if (tail - m_cached_head >= m_capacity) {
+            m_cached_head = m_head.load(memory_order_acquire);
+            if (tail - m_cached_head >= m_capacity) {
+                m_dropped.fetch_add(1, memory_order_relaxed);
+                return false;
+            }
+        }
+
+        m_slots[tail & m_mask] = move(item);
+        m_tail.store(tail + 1, memory_order_release);
+
+        // Depth as seen by the producer; may overstate it by what the
+        // consumer popped since m_cached_head was refreshed
+        size_t depth = tail + 1 - m_cached_head;
+        if (depth > m_high_water.load(memory_order_relaxed)) {
+            m_high_water.store(depth, memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Consumer only
+    bool pop(T& item) {
+        size_t head = m_head.load(memory_order_relaxed);
+        if (head == m_cached_tail) {
+            m_cached_tail = m_tail.load(memory_order_acquire);
+            if (head == m_cached_tail) return false;
+        }
+
+        item = move(m_slots[head & m_mask]);
+        m_head.store(head + 1, memory_order_release);
+        return true;
+    }
+
+    // Approximate when called concurrently with push/pop
+    bool empty() const {
+        return m_head.load(memory_order_acquire) == m_tail.load(memory_order_acquire);
+    }
+
+    size_t size() const {
+        return m_tail.load(memory_order_acquire) - m_head.load(memory_order_acquire);
+    }
+
+    size_t capacity() const { return m_capacity; }
+    size_t high_water() const { return m_high_water.load(memory_order_relaxed); }
+    uint64_t dropped() const { return m_dropped.load(memory_order_relaxed); }
+
+private:
+    static size_t round_up(size_t n) {
+        size_t capacity = 2;
+        while (capacity < n) capacity <<= 1;
+        return capacity;
+    }
+
+    const size_t m_capacity;
+    const size_t m_mask;
+    unique_ptr<T[]> m_slots;
+
+    // Producer and consumer indices on separate cache lines, each with a
+    // private copy of the other side's index to avoid re-reading it
+    alignas(64) atomic<size_t> m_head;
+    alignas(64) atomic<size_t> m_tail;
+    alignas(64) size_t m_cached_head;   // producer's view of m_head
+    alignas(64) size_t m_cached_tail;   // consumer's view of m_tail
+
+    atomic<size_t> m_high_water;
+    atomic<uint64_t> m_dropped;
+};
+
+#endif // UTILS_SPSC_RING_H
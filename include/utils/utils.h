@@ -6,6 +6,8 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <map>
+#include <functional>
+#include <string_view>
 
 
 using namespace std;
@@ -22,7 +24,16 @@ namespace utils {
 
     string hmac_sha256(const string& key, const string& data);
 
-    string pretty(string j);
+    // JSON text re-indented by four spaces per level, as dump(4) would
+    string pretty(string_view text);
+
+    // value escaped for use inside an OpenMetrics label's double quotes
+    string openmetrics_label(string_view value);
+
+    // Cheaply pulls the JSON-RPC "id" (and "method", if present) out of a
+    // serialized request without building a DOM. Returns false if there is
+    // no integer id.
+    bool peek_rpc_header(const string& message, long long& id, string& method);
 
     string printmap(map<string , string> mpp);
 
@@ -36,6 +47,10 @@ namespace utils {
     void printHeader();
     void printHelp();
     void clear_console();
+
+    // Redraws render() in place every interval_ms (cursor home + clear to
+    // end, so the screen doesn't flash) until 'q' is pressed.
+    void watch_console(const function<string()>& render, int interval_ms);
     bool is_key_pressed(char key);
     bool check_key_pressed(char key);
 }
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef WEBSOCKET_IO_LOOP_H
+#define WEBSOCKET_IO_LOOP_H
+
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+// Busy-poll settings for an event loop, read by the loop on every pass so
+// they can be changed while it runs.
+//   busy_poll_us < 0: block in run_one() (the classic run() behaviour)
+//   busy_poll_us = 0: spin on poll() forever, never sleep
+//   busy_poll_us > 0: spin on poll(), backing off to run_one() after that
+//                     many microseconds without an event
+struct io_loop_mode {
+    atomic<long> busy_poll_us{-1};
+};
+
+inline void io_loop_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Drives an asio io_service/io_context until it is stopped or runs out of
+// work. Spinning trades a core for skipping the futex wakeup between a
+// frame arriving and its handler running.
+template <typename IoService>
+void run_io_loop(IoService &io, io_loop_mode const &mode) {
+    auto idle_since = chrono::steady_clock::now();
+
+    while (!io.stopped()) {
+        long busy_poll_us = mode.busy_poll_us.load(memory_order_relaxed);
+
+        if (busy_poll_us < 0) {
+            io.run_one();
+            continue;
+        }
+
+        if (io.poll() > 0) {
+            idle_since = chrono::steady_clock::now();
+            continue;
+        }
+
+        if (busy_poll_us > 0 &&
+            chrono::steady_clock::now() - idle_since > chrono::microseconds(busy_poll_us)) {
+            io.run_one();
+            idle_since = chrono::steady_clock::now();
+            continue;
+        }
+
+        io_loop_cpu_relax();
+    }
+}
+
+#endif // WEBSOCKET_IO_LOOP_H
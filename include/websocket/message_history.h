@@ -0,0 +1,63 @@
+#ifndef WEBSOCKET_MESSAGE_HISTORY_H
+#define WEBSOCKET_MESSAGE_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Bounded history of a connection's messages: a ring of at most `capacity`
+// entries whose payloads together stay under `byte_budget`. The oldest
+// entries are evicted first and, if spilling is enabled, appended to a
+// gzip-compressed log (one "<seq>\t<text>" line each) instead of being lost.
+// Every entry gets a sequence number, so pages stay stable as the window moves.
+class message_history {
+public:
+    struct entry {
+        uint64_t seq;
+        string text;
+    };
+
+    message_history(size_t capacity, size_t byte_budget);
+    ~message_history();
+
+    message_history(const message_history&) = delete;
+    void operator=(const message_history&) = delete;
+
+    void append(string text);
+
+    // Copies out retained entries [first, first + count) counted from the
+    // oldest one still retained.
+    vector<entry> page(size_t first, size_t count) const;
+
+    size_t size() const;
+    size_t bytes() const;
+    // Entries appended since the connection opened, including evicted ones
+    uint64_t total() const;
+    uint64_t evicted() const;
+
+    // Starts appending evicted entries to path (gzip); an empty path stops.
+    bool set_spill_file(string const &path, string &error);
+    string spill_file() const;
+
+private:
+    void evict_oldest();
+
+    mutable mutex m_mutex;
+    vector<entry> m_ring;
+    size_t m_first;
+    size_t m_count;
+    size_t m_bytes;
+    const size_t m_byte_budget;
+    uint64_t m_next_seq;
+    uint64_t m_evicted;
+
+    // gzFile, kept opaque so users of this header don't need zlib.h
+    void* m_spill;
+    string m_spill_path;
+};
+
+#endif // WEBSOCKET_MESSAGE_HISTORY_H
@@ -0,0 +1,53 @@
+#ifndef WEBSOCKET_TLS_SESSION_CACHE_H
+#define WEBSOCKET_TLS_SESSION_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/asio/ssl/context.hpp>
+#include <openssl/ssl.h>
+
+using namespace std;
+
+// One TLS context shared by every connection, plus the client-side session
+// cache OpenSSL leaves to the application: the last session (or TLS 1.3
+// ticket) negotiated with each host:port is offered again on the next
+// handshake there, turning it into an abbreviated one.
+class tls_session_cache {
+public:
+    explicit tls_session_cache(shared_ptr<boost::asio::ssl::context> context);
+    ~tls_session_cache();
+
+    tls_session_cache(const tls_session_cache&) = delete;
+    void operator=(const tls_session_cache&) = delete;
+
+    shared_ptr<boost::asio::ssl::context> context() const { return m_context; }
+
+    // Before the handshake: offers the cached session for key, and files
+    // the one the server hands back under it
+    void attach(SSL* ssl, string const &key);
+
+    // After the handshake
+    void record_handshake(SSL* ssl);
+    uint64_t full_handshakes() const { return m_full.load(memory_order_relaxed); }
+    uint64_t resumed_handshakes() const { return m_resumed.load(memory_order_relaxed); }
+    size_t cached_sessions() const;
+
+private:
+    static int on_new_session(SSL* ssl, SSL_SESSION* session);
+
+    shared_ptr<boost::asio::ssl::context> m_context;
+
+    mutable mutex m_mutex;
+    // Keys live in the map so the SSL objects can point at them
+    map<string, SSL_SESSION*> m_sessions;
+
+    atomic<uint64_t> m_full;
+    atomic<uint64_t> m_resumed;
+};
+
+#endif // WEBSOCKET_TLS_SESSION_CACHE_H
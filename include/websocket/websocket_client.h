@@ -2,62 +2,373 @@
 #define WEBSOCKET_CLIENT_H
 
 #include <map>
+#include <set>
+#include <memory>
 #include <string>
 #include <mutex>
+#include <functional>
+#include <future>
 #include <condition_variable>
 #include <vector>
 #include <thread>
+#include <atomic>
+#include <ostream>
 
 #include <websocketpp/config/asio_client.hpp> 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/ssl/context.hpp> 
 #include <websocketpp/client.hpp> 
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
 
 #include <nlohmann/json.hpp>
 
+#include "latency/tracker.h"
+#include "latency/clock_offset.h"
+#include "websocket/io_loop.h"
+#include "utils/spsc_ring.h"
+#include "utils/json_scan.h"
+#include "utils/request_id.h"
+#include "utils/arena_json.h"
+#include "market/feed_decoder.h"
+#include "websocket/message_history.h"
+#include "websocket/tls_session_cache.h"
+
 using json = nlohmann::json;
 using namespace std;
 
 extern bool AUTH_SENT;
 extern bool isStreaming;
 
+// asio_tls_client plus the permessage-deflate extension
+struct deflate_tls_client_config : public websocketpp::config::asio_tls_client {
+    typedef deflate_tls_client_config type;
+    typedef websocketpp::config::asio_tls_client base;
+
+    typedef base::concurrency_type concurrency_type;
+    typedef base::request_type request_type;
+    typedef base::response_type response_type;
+    typedef base::message_type message_type;
+    typedef base::con_msg_manager_type con_msg_manager_type;
+    typedef base::endpoint_msg_manager_type endpoint_msg_manager_type;
+    typedef base::alog_type alog_type;
+    typedef base::elog_type elog_type;
+    typedef base::rng_type rng_type;
+
+    struct transport_config : public base::transport_config {
+        typedef type::concurrency_type concurrency_type;
+        typedef type::alog_type alog_type;
+        typedef type::elog_type elog_type;
+        typedef type::request_type request_type;
+        typedef type::response_type response_type;
+        typedef websocketpp::transport::asio::tls_socket::endpoint socket_type;
+    };
+    typedef websocketpp::transport::asio::endpoint<transport_config> transport_type;
+
+    struct permessage_deflate_config {};
+    typedef websocketpp::extensions::permessage_deflate::enabled<permessage_deflate_config> permessage_deflate_type;
+};
+
 typedef websocketpp::client<websocketpp::config::asio_tls_client> client;
+// Offers permessage-deflate in its handshake; same message and timer types
+typedef websocketpp::client<deflate_tls_client_config> deflate_client;
+// ws:// without TLS, for local stand-in servers and benchmarks
+typedef websocketpp::client<websocketpp::config::asio_client> plain_client;
 typedef shared_ptr<boost::asio::ssl::context> context_ptr;
 
 class websocket_endpoint;
 
-class connection_metadata {
+// Connections are spread over independent event loops by role, so a busy
+// market-data feed can't delay order acknowledgements on a trading connection.
+enum io_role {
+    IO_ROLE_TRADING,
+    IO_ROLE_MARKET_DATA,
+    IO_ROLE_COUNT
+};
+
+// Placement of one I/O thread: cpu < 0 leaves it unpinned, fifo_priority 0
+// keeps the default time-sharing scheduler. busy_poll_us >= 0 spins the
+// event loop instead of blocking (see io_loop_mode); best combined with cpu.
+struct io_thread_config {
+    int cpu = -1;
+    int fifo_priority = 0;
+    long busy_poll_us = -1;
+};
+
+// Per-connection throughput counters. Written by whichever thread sends or
+// receives, read lock-free by the metrics exporter.
+struct connection_stats {
+    atomic<uint64_t> messages_in{0};
+    atomic<uint64_t> bytes_in{0};
+    atomic<uint64_t> messages_out{0};
+    atomic<uint64_t> bytes_out{0};
+};
+
+class connection_metadata : public enable_shared_from_this<connection_metadata> {
 private:
     int m_id;
+    // Replaced on every reconnect. Exactly one of m_client,
+    // m_deflate_client and m_plain_client, the shard's websocketpp
+    // clients, is set.
+    mutable mutex m_hdl_mutex;
     websocketpp::connection_hdl m_hdl;
+    client* m_client;
+    deflate_client* m_deflate_client;
+    plain_client* m_plain_client;
+
+    // Whether permessage-deflate was requested, and agreed by the server
+    const bool m_compress;
+    atomic<bool> m_deflate_negotiated;
+
+    // Operations on whichever websocketpp client owns the connection
+    template <typename Operation> auto with_client(Operation operation);
+    void send_frame(string const &message, websocketpp::lib::error_code &ec);
+    client::timer_ptr set_timer(long delay_ms, client::timer_handler handler);
     string m_status;
     string m_uri;
     string m_server;
     string m_error_reason;
-    vector<string> m_summaries;
+
+    // Sent/received payloads, and the one-line summaries shown by `show`
+    message_history m_messages;
+    message_history m_summaries;
 
     websocket_endpoint* m_endpoint;
+    io_role m_role;
+
+    connection_stats m_stats;
+
+public:
+    // Invoked on the consumer thread with the response to a request, or with a
+    // synthetic {"error": ...} object if the connection goes away first. The
+    // response lives in the consumer's arena: copy out whatever is kept.
+    typedef function<void(dom_json const &)> response_handler;
+
+private:
+    struct pending_request {
+        long long id = 0;       // 0 while the slot is free
+        LatencyTracker::Handle latency_handle = 0;
+        string method;
+        response_handler handler;
+    };
+
+    // Requests awaiting a response. Ids this connection allocated sit in
+    // the ring slot their sequence selects; ids typed by hand, and ids whose
+    // slot is still taken by a far older request, go to the overflow map.
+    mutex m_pending_mutex;
+    vector<pending_request> m_pending_ring;
+    map<long long, pending_request> m_pending_overflow;
+    size_t m_pending_count;
+
+    pending_request* pending_slot(long long request_id);
+    bool take_pending(long long request_id, pending_request &request);
+
+    // public/get_time probes used to estimate the exchange clock offset.
+    // Only touched on the I/O thread.
+    ClockOffsetEstimator m_clock_offset;
+    client::timer_ptr m_probe_timer;
+    long long m_probe_id;
+    chrono::system_clock::time_point m_probe_sent;
+
+    // Heartbeats (public/set_heartbeat, test_request, public/test) are
+    // answered on the I/O thread and never reach the consumer. Apart from
+    // the counters, only touched on the I/O thread.
+    client::timer_ptr m_heartbeat_timer;
+    long long m_set_heartbeat_id;
+    long long m_heartbeat_test_id;
+    LatencyTracker::Handle m_heartbeat_handle;
+    chrono::steady_clock::time_point m_heartbeat_sent;
+    chrono::steady_clock::time_point m_last_received;
+    atomic<uint64_t> m_heartbeats_received;
+    atomic<int64_t> m_heartbeat_rtt_us;
+
+    bool send_control(string const &message);
+    void enable_heartbeat();
+    void send_heartbeat_test();
+    void schedule_heartbeat_check();
+    void on_heartbeat_check(websocketpp::lib::error_code const &ec);
+    bool handle_heartbeat(json_scan::rpc_fields const &notification);
+    bool handle_heartbeat_response(json_scan::rpc_fields const &response, uint64_t received_ticks);
+
+    // FEED_LATENCY series per subscription channel; looked up by string_view
+    map<string, int, less<>> m_feed_series;
+
+    // Typed updates for book, ticker, trades and price index frames.
+    // Consumer thread only.
+    feed::decoder m_feed_decoder;
+
+    // DOMs of received messages are built here and dropped together once
+    // the message is handled. Consumer thread only.
+    monotonic_arena m_dom_arena;
+
+    // Frame as received on the I/O thread, queued for the consumer thread
+    struct inbound_message {
+        string payload;
+        websocketpp::frame::opcode::value opcode;
+        uint64_t received_ticks;
+        chrono::system_clock::time_point received_wall;
+        LatencyTracker::Handle latency_handle;
+    };
+
+    // The I/O thread only pushes; parsing, printing and response routing
+    // happen on m_consumer. A full inbox drops the frame rather than stall reads.
+    spsc_ring<inbound_message> m_inbox;
+    thread m_consumer;
+    atomic<bool> m_consumer_running;
+    atomic<bool> m_consumer_sleeping;
+    mutex m_inbox_mutex;
+    condition_variable m_inbox_cv;
+
+    void consume_messages();
+    void process_message(inbound_message &message);
+
+    // Reconnect supervision. The timer and attempt count belong to the I/O
+    // thread; the session to restore is guarded by m_session_mutex.
+    atomic<bool> m_auto_reconnect;
+    atomic<bool> m_close_requested;
+    bool m_was_connected;
+    int m_reconnect_attempts;
+    client::timer_ptr m_reconnect_timer;
+    atomic<LatencyTracker::Handle> m_first_tick_handle;
+
+    mutex m_session_mutex;
+    string m_auth_request;      // last public/auth sent, replayed on reconnect
+    set<string> m_channels;     // channels the exchange confirmed as subscribed
+    size_t m_open_orders;
+
+    // TCP + TLS + WebSocket handshake time of the latest (re)connect
+    atomic<LatencyTracker::Handle> m_connect_handle;
+    chrono::steady_clock::time_point m_connect_started;
+    atomic<int64_t> m_connect_us;
+    atomic<bool> m_tls_resumed;
+
+    // A pre-warmed connection waiting in the pool, and whether it has
+    // logged in; m_access_token is its token, guarded by m_session_mutex
+    atomic<bool> m_spare;
+    atomic<bool> m_authorized;
+    string m_access_token;
+
+    void schedule_reconnect();
+    void on_reconnect_timer(websocketpp::lib::error_code const &ec);
+    void restore_session();
+    void replay_auth(string const &stored, function<void(bool)> done);
+    void restore_subscriptions(vector<string> const &channels, bool authorized);
+    void resync_open_orders();
+    void track_channels(string const &method, dom_json const &response);
+    json restore_request(string const &method);
+
+    void schedule_clock_probe(long delay_ms);
+    void on_clock_probe_timer(websocketpp::lib::error_code const &ec);
+    bool handle_clock_probe(json_scan::rpc_fields const &response, chrono::system_clock::time_point received);
+    void record_feed_latency(string_view channel, int64_t timestamp_ms, chrono::system_clock::time_point received);
 
 public:
     typedef websocketpp::lib::shared_ptr<connection_metadata> ptr;
 
-    mutex mtx;
-    condition_variable cv;
-    vector<string> m_messages;
-    bool MSG_PROCESSED;
+    static constexpr long CLOCK_PROBE_INTERVAL_MS = 10000;
+
+    // Pending ring slots; a power of two
+    static constexpr size_t PENDING_RING_SIZE = 256;
+
+    // The exchange sends a heartbeat every interval (10 s minimum); a
+    // connection silent for STALE_AFTER_INTERVALS of them is closed, which
+    // hands it to the reconnect supervisor
+    static constexpr int HEARTBEAT_INTERVAL_S = 10;
+    static constexpr int STALE_AFTER_INTERVALS = 3;
+
+    // Reconnect delays double from the base up to the cap; each is then
+    // drawn uniformly from its upper half
+    static constexpr long RECONNECT_BASE_DELAY_MS = 250;
+    static constexpr long RECONNECT_MAX_DELAY_MS = 30000;
 
-    connection_metadata(int id, websocketpp::connection_hdl hdl, string uri, websocket_endpoint* endpoint = nullptr);
+    // error.code passed to response handlers of requests that never got a
+    // response because the connection closed or failed
+    static constexpr int REQUEST_CANCELLED = -1;
+
+    // History kept in memory per connection; older entries are dropped or,
+    // with a spill file set, compressed to disk
+    static constexpr size_t HISTORY_CAPACITY = 10000;
+    static constexpr size_t HISTORY_BYTE_BUDGET = 16 << 20;
+    static constexpr size_t SUMMARY_CAPACITY = 1000;
+    static constexpr size_t SUMMARY_BYTE_BUDGET = 1 << 20;
+
+    static constexpr size_t INBOX_CAPACITY = 4096;
+    // Empty polls the consumer spins through before sleeping
+    static constexpr int CONSUMER_SPIN_LIMIT = 2000;
+
+    connection_metadata(int id, websocketpp::connection_hdl hdl, string uri, websocket_endpoint* endpoint = nullptr,
+                        io_role role = IO_ROLE_TRADING, bool compress = false);
 
     int get_id();
     websocketpp::connection_hdl get_hdl();
     string get_status();
+    string get_uri() const { return m_uri; }
+    io_role get_role() const { return m_role; }
+    connection_stats const &get_stats() const { return m_stats; }
+    message_history &get_messages() { return m_messages; }
+    size_t inbox_high_water() const { return m_inbox.high_water(); }
+    uint64_t inbox_dropped() const { return m_inbox.dropped(); }
     void record_sent_message(string const &message);
     void record_summary(string const &message, string const &sent);
+    void record_summary(dom_json &parsed_msg, string const &sent);
+
+    // Points the metadata at a new websocketpp connection, on connect and
+    // on every reconnect
+    void set_connection(client * c, websocketpp::connection_hdl hdl);
+    void set_connection(deflate_client * c, websocketpp::connection_hdl hdl);
+    void set_connection(plain_client * c, websocketpp::connection_hdl hdl);
+
+    void close(websocketpp::close::status::value code, string const &reason, websocketpp::lib::error_code &ec);
+
+    // See websocket_endpoint::send
+    int send(string const &message, response_handler handler = nullptr);
+
+    // Logs in with a copy of a public/auth request sent elsewhere
+    void authorize(string const &auth_request);
+    bool is_authorized() const { return m_authorized.load(); }
+    string get_access_token();
+
+    void set_spare(bool spare) { m_spare.store(spare); }
+    bool is_spare() const { return m_spare.load(); }
+    bool is_compressed() const { return m_compress; }
+    bool tls_resumed() const { return m_tls_resumed.load(); }
+    // ws:// rather than wss://
+    bool is_plain() const { return is_plain_uri(m_uri); }
+    static bool is_plain_uri(string const &uri) { return uri.compare(0, 5, "ws://") == 0; }
 
-    void on_open(client * c, websocketpp::connection_hdl hdl);
-    void on_fail(client * c, websocketpp::connection_hdl hdl);
-    void on_close(client * c, websocketpp::connection_hdl hdl);
+    // Registers a request before it is sent; its response (matched by id) is
+    // routed to handler. Returns false if request_id is already in flight.
+    bool track_request(long long request_id, LatencyTracker::Handle handle, string const &method,
+                       response_handler handler);
+    // Forgets request_id without notifying its handler, e.g. if sending failed
+    void untrack_request(long long request_id);
+    // Fails every outstanding request, e.g. once the connection is gone
+    void cancel_pending_requests(string const &reason);
+    size_t pending_request_count();
+    // A fresh id of the given class for a request on this connection
+    long long next_request_id(request_id::id_class cls) { return request_id::next(m_id, cls); }
+
+    void cancel_clock_probe();
+    void cancel_heartbeat();
+
+    // With auto-reconnect on (the default), a connection that drops after
+    // opening is re-established, re-authorized and re-subscribed
+    void set_auto_reconnect(bool enabled) { m_auto_reconnect.store(enabled); }
+    bool get_auto_reconnect() const { return m_auto_reconnect.load(); }
+    // Marks the next close as intentional, so it is not reconnected
+    void request_close() { m_close_requested.store(true); }
+    // I/O thread only
+    void cancel_reconnect();
+
+    // The consumer thread drains the inbox until stopped; stop_consumer()
+    // processes whatever is still queued before returning.
+    void start_consumer();
+    void stop_consumer();
+
+    // Client is client, deflate_client or plain_client
+    template <typename Client> void on_open(Client * c, websocketpp::connection_hdl hdl);
+    template <typename Client> void on_fail(Client * c, websocketpp::connection_hdl hdl);
+    template <typename Client> void on_close(Client * c, websocketpp::connection_hdl hdl);
     void on_message(websocketpp::connection_hdl hdl, client::message_ptr msg);
 
     friend ostream &operator<< (ostream &out, connection_metadata const &data);
@@ -69,21 +380,97 @@ class websocket_endpoint {
 private:
     typedef map<int, connection_metadata::ptr> con_list;
 
-    client m_endpoint;
-    websocketpp::lib::shared_ptr<websocketpp::lib::thread> m_thread;
+    // One websocketpp client, with its own io_service and thread, per role
+    struct io_shard {
+        client endpoint;
+        // Run on endpoint's io_service and thread
+        deflate_client deflate_endpoint;
+        plain_client plain_endpoint;
+        websocketpp::lib::shared_ptr<websocketpp::lib::thread> thread;
+        io_thread_config config;
+        io_loop_mode mode;
+        atomic<long> tid{0};
+    };
+
+    // Shared by every connection of every shard
+    tls_session_cache m_tls_sessions;
+
+    io_shard m_shards[IO_ROLE_COUNT];
+
+    boost::asio::io_service &io_service_for(connection_metadata::ptr const &metadata) {
+        return m_shards[metadata->get_role()].endpoint.get_io_service();
+    }
 
     con_list m_connection_list;
     int m_next_id;
 
+    // Spare connections kept open, and logged in once credentials have been
+    // used, so connect() can hand one out without any handshake
+    struct spare_pool {
+        string uri;
+        size_t target = 0;
+    };
+    spare_pool m_spare_pools[IO_ROLE_COUNT];
+
+    // Last public/auth the user sent, for logging spares in
+    mutable mutex m_auth_mutex;
+    string m_auth_request;
+
+    int create_connection(string const &uri, io_role role, bool spare, bool compress);
+    int take_spare(string const &uri, io_role role, bool compress);
+    void fill_spare_pool(io_role role);
+
+    // Connections visible to the metrics exporter, indexed by id. Published
+    // once and never removed, so the exporter can walk it without a lock.
+    static constexpr int MAX_EXPORTED_CONNECTIONS = 64;
+    atomic<connection_metadata*> m_exported_connections[MAX_EXPORTED_CONNECTIONS];
+
 public:
     websocket_endpoint();
     ~websocket_endpoint();
 
-    int connect(string const &uri);
+    // The URI scheme picks the transport: wss:// (TLS) or ws://. compress
+    // offers permessage-deflate; wss:// market-data connections only, as
+    // inflating adds CPU time to every message
+    int connect(string const &uri, io_role role = IO_ROLE_TRADING, bool compress = false);
+    // Opens a new websocketpp connection for existing metadata; used by
+    // connect() and by the reconnect supervisor
+    bool open_connection(connection_metadata::ptr const &metadata, string &error);
     connection_metadata::ptr get_metadata(int id) const;
     void close(int id, websocketpp::close::status::value code, string reason);
-    int send(int id, string message);
+    // Sends message as is. If it is a JSON-RPC request with an integer id,
+    // its round trip is measured and its response passed to handler.
+    int send(int id, string message, connection_metadata::response_handler handler = nullptr);
+    // Sends a JSON-RPC request and returns a future for its outcome, so
+    // many requests can be in flight on one connection: the response's id
+    // and, if it failed, its "error". The response itself is printed and
+    // kept in the history. The future is not valid() if the message has no
+    // integer id or could not be sent.
+    future<json> send_request(int id, string message);
     int streamSubscriptions(const vector<string>& connections);
+
+    // Keeps count connections to uri open in advance for role; 0 empties
+    // the pool
+    void set_spare_pool(io_role role, string const &uri, size_t count);
+    // e.g. "2/2 ready for wss://... (TLS: 3 full, 5 resumed handshakes)"
+    string describe_spare_pool(io_role role) const;
+    tls_session_cache &tls_sessions() { return m_tls_sessions; }
+    string auth_request() const;
+
+    static const char* io_role_name(io_role role);
+    static bool parse_io_role(string const &name, io_role &role);
+
+    // Pins the role's I/O thread to a CPU, gives it a SCHED_FIFO priority
+    // and/or switches it to busy-polling; takes effect immediately. Needs
+    // CAP_SYS_NICE for SCHED_FIFO.
+    bool set_io_thread_config(io_role role, io_thread_config const &config, string &error);
+    io_thread_config get_io_thread_config(io_role role) const { return m_shards[role].config; }
+
+    // e.g. "trading (tid 4242, CPU 3, SCHED_FIFO 50, busy-poll)", read back from the thread
+    string describe_io_thread(io_role role) const;
+
+    // Prometheus text exposition of per-connection message/byte counters
+    void write_openmetrics(ostream &out) const;
 };
 
 #endif // WEBSOCKET_CLIENT_H
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "api/api.h"
+#include "api/order_encoder.h"
 #include "utils/utils.h"
 #include "json/json.hpp"
 #include "authentication/password.h"
@@ -14,7 +15,7 @@
 
 
 
-#include "latency/tracker.h"
+#include "latency/instrumentation.h"
 
 using namespace std;
 
@@ -81,6 +82,7 @@ string api::process(const string &input) {
     int id;
     string cmd;
     s >> id >> cmd;
+    jsonrpc::target = id;
 
     auto find = action_map.find(cmd);
     if (find == action_map.end()) {
@@ -121,6 +123,26 @@ string api::authorize(const string &input) {
     return j.dump();
 }
 
+// Orders are encoded from a template per shape, so an order only costs
+// writing its id, quantity and price; the REPL thread is the only caller
+static string encode_order(const char* method, string const &instrument, string const &access_key, bool contracts,
+                           double quantity, double price, string const &order_type, string const &label,
+                           string const &frc) {
+    static order_encoder encoder;
+
+    order_shape shape;
+    shape.method = method;
+    shape.instrument_name = instrument;
+    shape.access_token = access_key;
+    shape.type = order_type;
+    shape.label = label;
+    shape.time_in_force = frc;
+    shape.contracts = contracts;
+    shape.has_price = price > 0;
+
+    return encoder.encode(shape, jsonrpc::next_id(), quantity, price);
+}
+
 string api::sell(const string &input) {
     string sell;
     string id;
@@ -230,37 +252,21 @@ string api::sell(const string &input) {
         cin >> price;
     }
 
-    getLatencyTracker().start_measurement(LatencyTracker::ORDER_PLACEMENT);
-
-
-    jsonrpc j("private/sell");
-
-    j["params"] = {{"instrument_name", instrument},
-                   {"access_token", access_key}};
-
-    // Explicitly choose either amount or contracts based on choice
-    if (choice == 2 && amount > 0) { 
-        j["params"]["amount"] = amount;
-    }
-    else if (choice == 1 && contracts > 0) {
-        j["params"]["contracts"] = contracts;
-    }
-    else {
+    // Explicitly choose either amount or contracts based on choice. Checked
+    // before timing starts so a rejected order leaves no measurement behind.
+    if (!(choice == 2 && amount > 0) && !(choice == 1 && contracts > 0)) {
         utils::printerr("\nInvalid quantity specified\n");
         return "";
     }
 
-    if (price > 0) { 
-        j["params"]["price"] = price;
-    }
-    
-    j["params"]["type"] = order_type;
-    j["params"]["label"] = label;
-    j["params"]["time_in_force"] = frc;
+    LatencyTracker::Handle latency_handle = Instrumentation::start(LatencyTracker::ORDER_PLACEMENT);
 
-    getLatencyTracker().stop_measurement(LatencyTracker::ORDER_PLACEMENT);
+    string message = encode_order("private/sell", instrument, access_key, choice == 1, choice == 1 ? contracts : amount,
+                                  price, order_type, label, frc);
 
-    return j.dump();
+    Instrumentation::stop(latency_handle);
+
+    return message;
 }
 
 string api::buy(const string &input) {
@@ -370,37 +376,21 @@ string api::buy(const string &input) {
         cin >> price;
     }
 
-    getLatencyTracker().start_measurement(LatencyTracker::ORDER_PLACEMENT);
-
-
-    jsonrpc j("private/buy");
-
-    j["params"] = {{"instrument_name", instrument},
-                   {"access_token", access_key}};
-
-    // Explicitly choose either amount or contracts based on choice
-    if (choice == 2 && amount > 0) { 
-        j["params"]["amount"] = amount;
-    }
-    else if (choice == 1 && contracts > 0) {
-        j["params"]["contracts"] = contracts;
-    }
-    else {
+    // Explicitly choose either amount or contracts based on choice. Checked
+    // before timing starts so a rejected order leaves no measurement behind.
+    if (!(choice == 2 && amount > 0) && !(choice == 1 && contracts > 0)) {
         utils::printerr("\nInvalid quantity specified\n");
         return "";
     }
 
-    if (price > 0) { 
-        j["params"]["price"] = price;
-    }
-    
-    j["params"]["type"] = order_type;
-    j["params"]["label"] = label;
-    j["params"]["time_in_force"] = frc;
+    LatencyTracker::Handle latency_handle = Instrumentation::start(LatencyTracker::ORDER_PLACEMENT);
 
-    getLatencyTracker().stop_measurement(LatencyTracker::ORDER_PLACEMENT);
+    string message = encode_order("private/buy", instrument, access_key, choice == 1, choice == 1 ? contracts : amount,
+                                  price, order_type, label, frc);
 
-    return j.dump();
+    Instrumentation::stop(latency_handle);
+
+    return message;
 }
 
 string api::modify(const string &input) {
@@ -429,7 +419,7 @@ string api::modify(const string &input) {
     utils::printcmd("Enter the new amount (-1 to keep current): ");
     cin >> amount;
 
-    getLatencyTracker().start_measurement(LatencyTracker::ORDER_PLACEMENT);
+    LatencyTracker::Handle latency_handle = Instrumentation::start(LatencyTracker::ORDER_PLACEMENT);
 
 
     j["params"] = {{"order_id", ord_id}};
@@ -437,7 +427,7 @@ string api::modify(const string &input) {
     if (amount > 0) j["params"]["amount"] = amount;
     if (price > 0) j["params"]["price"] = price;
 
-    getLatencyTracker().stop_measurement(LatencyTracker::ORDER_PLACEMENT);
+    Instrumentation::stop(latency_handle);
 
     return j.dump();
 }
@@ -457,13 +447,13 @@ string api::cancel(const string &input) {
         return "";
     }
 
-    getLatencyTracker().start_measurement(LatencyTracker::ORDER_PLACEMENT);
+    LatencyTracker::Handle latency_handle = Instrumentation::start(LatencyTracker::ORDER_PLACEMENT);
 
     jsonrpc j;
     j["method"] = "private/cancel";
     j["params"]["order_id"] = ord_id;
 
-    getLatencyTracker().stop_measurement(LatencyTracker::ORDER_PLACEMENT);
+    Instrumentation::stop(latency_handle);
     return j.dump();
 }
 
@@ -474,7 +464,7 @@ string api::cancel_all(const string &input) {
     string option;
     string label;
 
-    getLatencyTracker().start_measurement(LatencyTracker::ORDER_PLACEMENT);
+    LatencyTracker::Handle latency_handle = Instrumentation::start(LatencyTracker::ORDER_PLACEMENT);
 
     jsonrpc j;
     j["params"] = {};
@@ -496,14 +486,14 @@ string api::cancel_all(const string &input) {
         j["params"]["currency"] = option;
     }
 
-    getLatencyTracker().stop_measurement(LatencyTracker::ORDER_PLACEMENT);
+    Instrumentation::stop(latency_handle);
     
     return j.dump();
 }
 
 string api::get_open_orders(const string &input) {
 
-    getLatencyTracker().start_measurement(LatencyTracker::MARKET_DATA_PROCESSING);
+    LatencyTracker::Handle latency_handle = Instrumentation::start(LatencyTracker::MARKET_DATA_PROCESSING);
 
     istringstream is(input);
 
@@ -532,13 +522,13 @@ string api::get_open_orders(const string &input) {
                         {"label", opt2}};
     }
 
-    getLatencyTracker().stop_measurement(LatencyTracker::MARKET_DATA_PROCESSING);
+    Instrumentation::stop(latency_handle);
 
     return j.dump();
 }
 
 string api::view_positions(const string &input) {
-    getLatencyTracker().start_measurement(LatencyTracker::MARKET_DATA_PROCESSING);
+    LatencyTracker::Handle latency_handle = Instrumentation::start(LatencyTracker::MARKET_DATA_PROCESSING);
     istringstream is(input);
     int id;
     string cmd;
@@ -581,12 +571,12 @@ string api::view_positions(const string &input) {
         j["params"]["kind"] = kind;
     }
     
-    getLatencyTracker().stop_measurement(LatencyTracker::MARKET_DATA_PROCESSING);
+    Instrumentation::stop(latency_handle);
     return j.dump();
 }
 
 string api::get_orderbook(const string &input) {
-    getLatencyTracker().start_measurement(LatencyTracker::MARKET_DATA_PROCESSING);
+    LatencyTracker::Handle latency_handle = Instrumentation::start(LatencyTracker::MARKET_DATA_PROCESSING);
     istringstream is(input);
     int id;
     string cmd;
@@ -607,7 +597,7 @@ string api::get_orderbook(const string &input) {
         {"instrument_name", instrument},
         {"depth", depth}
     };
-    getLatencyTracker().stop_measurement(LatencyTracker::MARKET_DATA_PROCESSING);
+    Instrumentation::stop(latency_handle);
     return j.dump();
 }
 
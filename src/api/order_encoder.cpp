@@ -0,0 +1,112 @@
+#include "api/order_encoder.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+#include "json/json.hpp"
+
+using namespace std;
+
+using json = nlohmann::json;
+
+static void append_integer(string &out, long long value) {
+    char digits[24];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
+}
+
+// As dump() writes a double: shortest round-trip digits, "null" if not finite
+static void append_double(string &out, double value) {
+    if (!isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char digits[64];
+    char* end = nlohmann::detail::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, end - digits);
+}
+
+string order_encoder::render(order_shape const &shape, long long id, double quantity, double price) {
+    json j;
+    j["jsonrpc"] = "2.0";
+    j["method"] = shape.method;
+    j["id"] = id;
+
+    j["params"] = {{"instrument_name", shape.instrument_name},
+                   {"access_token", shape.access_token}};
+
+    if (shape.contracts) {
+        j["params"]["contracts"] = static_cast<int>(quantity);
+    } else {
+        j["params"]["amount"] = quantity;
+    }
+
+    if (shape.has_price) {
+        j["params"]["price"] = price;
+    }
+
+    j["params"]["type"] = shape.type;
+    j["params"]["label"] = shape.label;
+    j["params"]["time_in_force"] = shape.time_in_force;
+
+    return j.dump();
+}
+
+order_encoder::order_template const &order_encoder::template_for(order_shape const &shape) {
+    m_key.clear();
+    for (string const *field : {&shape.method, &shape.instrument_name, &shape.access_token, &shape.type,
+                                &shape.label, &shape.time_in_force}) {
+        m_key += *field;
+        m_key += '\0';
+    }
+    m_key += shape.contracts ? 'c' : 'a';
+    m_key += shape.has_price ? 'p' : '-';
+
+    auto it = m_templates.find(m_key);
+    if (it != m_templates.end()) return it->second;
+
+    if (m_templates.size() >= MAX_TEMPLATES) m_templates.clear();
+
+    // Keys are followed by their value only outside strings, where a quote
+    // would be escaped, so each one is found exactly. Objects dump their
+    // keys sorted: id, then the quantity, then price.
+    string text = render(shape, 0, 0, 0);
+    vector<const char*> keys = {"\"id\":", shape.contracts ? "\"contracts\":" : "\"amount\":"};
+    if (shape.has_price) keys.push_back("\"price\":");
+
+    order_template made;
+    made.contracts = shape.contracts;
+    made.has_price = shape.has_price;
+
+    size_t piece_start = 0;
+    for (const char* key : keys) {
+        size_t value_start = text.find(key, piece_start) + strlen(key);
+        size_t value_end = text.find_first_of(",}", value_start);
+        made.pieces.push_back(text.substr(piece_start, value_start - piece_start));
+        piece_start = value_end;
+    }
+    made.pieces.push_back(text.substr(piece_start));
+
+    return m_templates.emplace(m_key, move(made)).first->second;
+}
+
+string const &order_encoder::encode(order_shape const &shape, long long id, double quantity, double price) {
+    order_template const &made = template_for(shape);
+
+    m_buffer.clear();
+    m_buffer += made.pieces[0];
+    append_integer(m_buffer, id);
+    m_buffer += made.pieces[1];
+    if (made.contracts) {
+        append_integer(m_buffer, static_cast<int>(quantity));
+    } else {
+        append_double(m_buffer, quantity);
+    }
+    m_buffer += made.pieces[2];
+    if (made.has_price) {
+        append_double(m_buffer, price);
+        m_buffer += made.pieces[3];
+    }
+    return m_buffer;
+}
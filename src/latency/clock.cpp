@@ -0,0 +1,73 @@
+#include "latency/clock.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+
+#if LATENCY_CLOCK_HAS_TSC
+#include <cpuid.h>
+#endif
+
+using namespace std;
+
+LatencyClock::LatencyClock() :
+    m_source(STEADY),
+    m_ns_per_tick(1.0),
+    m_calibrated(false)
+{
+    // DERIBIT_LATENCY_CLOCK=steady forces the portable clock; otherwise use
+    // the TSC whenever the CPU guarantees it is invariant.
+    const char* requested = getenv("DERIBIT_LATENCY_CLOCK");
+    if (requested && strcmp(requested, "steady") == 0) return;
+    set_source(TSC);
+}
+
+bool LatencyClock::tsc_available() {
+#if LATENCY_CLOCK_HAS_TSC
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+    return (edx & (1u << 8)) != 0; // Invariant TSC
+#else
+    return false;
+#endif
+}
+
+bool LatencyClock::set_source(Source source) {
+    if (source == TSC) {
+        if (!tsc_available()) return false;
+        if (!m_calibrated) calibrate_tsc();
+    }
+    m_source.store(source, memory_order_release);
+    return true;
+}
+
+void LatencyClock::calibrate_tsc() {
+#if LATENCY_CLOCK_HAS_TSC
+    // Bracket a short sleep with paired steady_clock/TSC readings; the
+    // sleep is long enough that the read overhead is negligible.
+    unsigned int aux;
+    uint64_t steady_begin = steady_ticks();
+    uint64_t tsc_begin = __rdtscp(&aux);
+
+    this_thread::sleep_for(chrono::milliseconds(20));
+
+    uint64_t steady_end = steady_ticks();
+    uint64_t tsc_end = __rdtscp(&aux);
+
+    if (tsc_end > tsc_begin) {
+        m_ns_per_tick.store(static_cast<double>(steady_end - steady_begin) / (tsc_end - tsc_begin),
+                            memory_order_relaxed);
+    }
+    m_calibrated = true;
+#endif
+}
+
+string LatencyClock::describe() const {
+    if (source() != TSC) return "steady_clock";
+
+    ostringstream os;
+    os << "tsc (invariant, " << fixed << setprecision(3) << 1.0 / m_ns_per_tick.load(memory_order_relaxed) << " GHz)";
+    return os.str();
+}
@@ -0,0 +1,34 @@
+#include "latency/clock_offset.h"
+
+using namespace std;
+
+ClockOffsetEstimator::ClockOffsetEstimator() :
+    m_samples(),
+    m_sample_count(0),
+    m_next_sample(0),
+    m_offset_us(0),
+    m_rtt_us(0),
+    m_has_estimate(false)
+{}
+
+void ClockOffsetEstimator::add_sample(int64_t local_send_us, int64_t server_time_ms, int64_t local_recv_us) {
+    if (local_recv_us < local_send_us) return;
+
+    Sample sample;
+    sample.rtt_us = local_recv_us - local_send_us;
+    // Assume the server read its clock halfway through the round trip
+    sample.offset_us = server_time_ms * 1000 - (local_send_us + sample.rtt_us / 2);
+
+    m_samples[m_next_sample] = sample;
+    m_next_sample = (m_next_sample + 1) % WINDOW;
+    if (m_sample_count < WINDOW) ++m_sample_count;
+
+    const Sample* best = &m_samples[0];
+    for (int i = 1; i < m_sample_count; ++i) {
+        if (m_samples[i].rtt_us < best->rtt_us) best = &m_samples[i];
+    }
+
+    m_offset_us.store(best->offset_us, memory_order_relaxed);
+    m_rtt_us.store(best->rtt_us, memory_order_relaxed);
+    m_has_estimate.store(true, memory_order_release);
+}
@@ -0,0 +1,147 @@
+#include "latency/histogram.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+void LatencyHistogram::clear() {
+    for (auto& c : counts) {
+        c.store(0, memory_order_relaxed);
+    }
+    total_count.store(0, memory_order_relaxed);
+    total_sum.store(0, memory_order_relaxed);
+    min_value.store(numeric_limits<uint64_t>::max(), memory_order_relaxed);
+    max_value.store(0, memory_order_relaxed);
+}
+
+void LatencyHistogram::merge_into(HistogramSnapshot& snapshot) const {
+    uint64_t merged = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        uint64_t c = counts[i].load(memory_order_relaxed);
+        snapshot.counts[i] += c;
+        merged += c;
+    }
+    // Use the bucket total rather than total_count so percentiles stay
+    // consistent with the buckets even if the owner is mid-record.
+    snapshot.total_count += merged;
+    snapshot.total_sum += total_sum.load(memory_order_relaxed);
+
+    uint64_t lo = min_value.load(memory_order_relaxed);
+    uint64_t hi = max_value.load(memory_order_relaxed);
+    if (lo < snapshot.min_value) snapshot.min_value = lo;
+    if (hi > snapshot.max_value) snapshot.max_value = hi;
+}
+
+HistogramSnapshot::HistogramSnapshot() :
+    counts(LatencyHistogram::BUCKET_COUNT, 0),
+    total_count(0),
+    total_sum(0),
+    min_value(numeric_limits<uint64_t>::max()),
+    max_value(0)
+{}
+
+double HistogramSnapshot::mean() const {
+    if (total_count == 0) return 0.0;
+    return static_cast<double>(total_sum) / total_count;
+}
+
+uint64_t HistogramSnapshot::value_at_quantile(double q) const {
+    if (total_count == 0) return 0;
+    if (q <= 0.0) return min();
+    if (q >= 1.0) return max_value;
+
+    // Estimated value of the sample at 0-based rank k. A bucket's samples
+    // are taken as spread evenly from its lowest to its highest equivalent
+    // value (a lone sample sits in the middle), within the observed range.
+    auto sample_value = [this](uint64_t k) -> double {
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (k >= seen + counts[i]) {
+                seen += counts[i];
+                continue;
+            }
+            double lowest = LatencyHistogram::bucket_lower_bound(i);
+            double highest = LatencyHistogram::bucket_upper_bound(i);
+            double value = counts[i] == 1 ? (lowest + highest) / 2
+                                          : lowest + (highest - lowest) * (k - seen) / (counts[i] - 1);
+            return std::min(std::max(value, double(min_value)), double(max_value));
+        }
+        return max_value;
+    };
+
+    // Fractional rank, interpolated between the samples either side of it
+    // (possibly in different buckets), so the median of {100, 200} is 150
+    double rank = q * (total_count - 1);
+    uint64_t below = static_cast<uint64_t>(rank);
+    double value = sample_value(below);
+    if (rank > below) value += (sample_value(below + 1) - value) * (rank - below);
+    return static_cast<uint64_t>(value + 0.5);
+}
+
+void HistogramSnapshot::record(uint64_t ns, uint64_t count) {
+    if (count == 0) return;
+    counts[LatencyHistogram::bucket_index(ns)] += count;
+    total_count += count;
+    total_sum += ns * count;
+    if (ns < min_value) min_value = ns;
+    if (ns > max_value) max_value = ns;
+}
+
+HistogramSnapshot HistogramSnapshot::corrected_for_coordinated_omission(uint64_t expected_interval_ns) const {
+    HistogramSnapshot corrected = *this;
+    if (expected_interval_ns == 0) return corrected;
+
+    const uint64_t interval = expected_interval_ns;
+
+    for (size_t i = 0; i < counts.size(); ++i) {
+        uint64_t c = counts[i];
+        if (c == 0) continue;
+
+        uint64_t lower = LatencyHistogram::bucket_lower_bound(i);
+        uint64_t upper = LatencyHistogram::bucket_upper_bound(i);
+        // Representative value of the bucket, bounded by what was observed
+        uint64_t value = lower + (upper - lower) / 2;
+        if (value > max_value) value = max_value;
+        if (value < min_value) value = min_value;
+        if (value < 2 * interval) continue;
+
+        // Synthetic samples are value - k*interval for k = 1..n, all >= interval.
+        // Rather than adding them one by one, count how many land in each
+        // bucket at or below this one.
+        uint64_t n = value / interval - 1;
+        uint64_t smallest = value - n * interval;
+        if (smallest < corrected.min_value) corrected.min_value = smallest;
+
+        for (size_t j = LatencyHistogram::bucket_index(smallest); j <= i; ++j) {
+            uint64_t lo = LatencyHistogram::bucket_lower_bound(j);
+            uint64_t hi = LatencyHistogram::bucket_upper_bound(j);
+            if (hi >= value) hi = value - 1;
+            if (lo < smallest) lo = smallest;
+            if (lo > hi) continue;
+
+            // k values with lo <= value - k*interval <= hi
+            uint64_t k_min = (value - hi + interval - 1) / interval;
+            uint64_t k_max = (value - lo) / interval;
+            if (k_min < 1) k_min = 1;
+            if (k_max > n) k_max = n;
+            if (k_min > k_max) continue;
+
+            uint64_t added = k_max - k_min + 1;
+            corrected.counts[j] += added * c;
+            corrected.total_count += added * c;
+            // Sum of value - k*interval over k_min..k_max
+            corrected.total_sum += c * (added * value - interval * (k_min + k_max) * added / 2);
+        }
+    }
+    return corrected;
+}
+
+uint64_t HistogramSnapshot::count_at_or_below(uint64_t ns) const {
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (LatencyHistogram::bucket_upper_bound(i) > ns) break;
+        seen += counts[i];
+    }
+    return seen;
+}
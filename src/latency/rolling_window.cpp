@@ -0,0 +1,100 @@
+#include "latency/rolling_window.h"
+
+#include <chrono>
+#include <time.h>
+
+using namespace std;
+
+namespace {
+    const uint64_t recycling_bit = 1ull << 63;
+    const uint64_t slice_ns = RollingWindow::SLICE_SECONDS * 1000000000ull;
+}
+
+RollingWindow::RollingWindow() {
+    // Slice counts are left untouched until a slice is first claimed, so
+    // the pages behind slices that are never used are never faulted in
+    clear();
+}
+
+uint64_t RollingWindow::now_ns() {
+#ifdef CLOCK_MONOTONIC_COARSE
+    // A few ms of resolution is plenty for multi-second slices and it avoids
+    // a full clock read on the hot path.
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Single-writer update: plain load/store on relaxed atomics
+template <typename T>
+static void bump(atomic<T>& slot, uint64_t delta) {
+    slot.store(slot.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+RollingWindow::Slice* RollingWindow::claim(uint64_t id) {
+    Slice& slice = m_slices[id % SLOT_COUNT];
+
+    uint64_t current = slice.id.load(memory_order_relaxed);
+    if (current == id) return &slice;
+    // Only move a slot forward
+    if (current > id) return nullptr;
+
+    // Readers skip the slice until it is tagged with its new id
+    slice.id.store(id | recycling_bit, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (auto& c : slice.counts) {
+        c.store(0, memory_order_relaxed);
+    }
+    slice.total_sum.store(0, memory_order_relaxed);
+    slice.max_value.store(0, memory_order_relaxed);
+    slice.id.store(id, memory_order_release);
+    return &slice;
+}
+
+void RollingWindow::record(uint64_t ns, uint64_t now) {
+    Slice* slice = claim(now / slice_ns + 1);
+    if (!slice) return;
+
+    bump(slice->counts[LatencyHistogram::bucket_index(ns)], 1);
+    bump(slice->total_sum, ns);
+    if (ns > slice->max_value.load(memory_order_relaxed)) slice->max_value.store(ns, memory_order_relaxed);
+}
+
+void RollingWindow::merge_into(HistogramSnapshot& snapshot, int seconds, uint64_t now) const {
+    uint64_t newest = now / slice_ns + 1;
+    uint64_t slices = (seconds + SLICE_SECONDS - 1) / SLICE_SECONDS;
+    if (slices < 1) slices = 1;
+    if (slices > SLOT_COUNT - 1) slices = SLOT_COUNT - 1;
+
+    for (uint64_t id = newest; id + slices > newest && id > 0; --id) {
+        const Slice& slice = m_slices[id % SLOT_COUNT];
+        if (slice.id.load(memory_order_acquire) != id) continue;
+
+        uint64_t merged = 0;
+        uint64_t lowest = 0;
+        for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+            uint64_t c = slice.counts[i].load(memory_order_relaxed);
+            if (c && !merged) lowest = LatencyHistogram::bucket_lower_bound(i);
+            snapshot.counts[i] += c;
+            merged += c;
+        }
+        if (!merged) continue;
+
+        // Slices keep no exact minimum; the lowest occupied bucket is close
+        snapshot.total_count += merged;
+        snapshot.total_sum += slice.total_sum.load(memory_order_relaxed);
+        uint64_t hi = slice.max_value.load(memory_order_relaxed);
+        if (lowest < snapshot.min_value) snapshot.min_value = lowest;
+        if (hi > snapshot.max_value) snapshot.max_value = hi;
+    }
+}
+
+void RollingWindow::clear() {
+    for (auto& slice : m_slices) {
+        slice.id.store(0, memory_order_release);
+    }
+}
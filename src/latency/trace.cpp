@@ -0,0 +1,123 @@
+#include "latency/trace.h"
+
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+Tracer::Tracer() :
+    m_buffer_count(0),
+    m_session_start_ticks(0)
+{
+    for (auto& b : m_buffers) {
+        b.store(nullptr, memory_order_relaxed);
+    }
+}
+
+Tracer::~Tracer() {
+    for (auto& b : m_buffers) {
+        delete b.load(memory_order_acquire);
+    }
+}
+
+Tracer::ThreadBuffer* Tracer::local_buffer() {
+    thread_local ThreadBuffer* cached = nullptr;
+    thread_local bool registered = false;
+
+    if (registered) return cached;
+    registered = true;
+
+    int slot = m_buffer_count.fetch_add(1, memory_order_relaxed);
+    if (slot >= MAX_TRACE_THREADS) return nullptr;
+
+    ThreadBuffer* buffer = new ThreadBuffer();
+    buffer->tid = slot + 1;
+    m_buffers[slot].store(buffer, memory_order_release);
+    cached = buffer;
+    return buffer;
+}
+
+void Tracer::start() {
+    m_session_start_ticks.store(getLatencyTracker().get_clock().start_ticks(), memory_order_release);
+    enabled.store(true, memory_order_release);
+}
+
+void Tracer::stop() {
+    enabled.store(false, memory_order_release);
+}
+
+void Tracer::record(const char* name, uint64_t start_ticks, uint64_t end_ticks) {
+    ThreadBuffer* buffer = local_buffer();
+    if (!buffer) return;
+
+    uint64_t head = buffer->head.load(memory_order_relaxed);
+    Event& event = buffer->events[head & (EVENTS_PER_THREAD - 1)];
+    event.name.store(name, memory_order_relaxed);
+    event.start_ticks.store(start_ticks, memory_order_relaxed);
+    event.end_ticks.store(end_ticks, memory_order_relaxed);
+    buffer->head.store(head + 1, memory_order_release);
+}
+
+void Tracer::set_thread_name(const char* name) {
+    ThreadBuffer* buffer = local_buffer();
+    if (buffer) buffer->name.store(name, memory_order_release);
+}
+
+long Tracer::dump(const string& path, string& error) {
+    ofstream out(path);
+    if (!out) {
+        error = "cannot open " + path;
+        return -1;
+    }
+
+    const LatencyClock& clock = getLatencyTracker().get_clock();
+    uint64_t session_start = m_session_start_ticks.load(memory_order_acquire);
+    long written = 0;
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    out << fixed << setprecision(3);
+
+    for (auto& b : m_buffers) {
+        ThreadBuffer* buffer = b.load(memory_order_acquire);
+        if (!buffer) continue;
+
+        const char* thread_name = buffer->name.load(memory_order_acquire);
+        if (thread_name) {
+            out << (written ? "," : "")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"args\":{\"name\":\"" << thread_name << "\"}}";
+            ++written;
+        }
+
+        // Spans still in the ring; the owner may be overwriting the oldest
+        // ones concurrently, which the start-time filter below tolerates.
+        uint64_t head = buffer->head.load(memory_order_acquire);
+        uint64_t first = head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD : 0;
+
+        for (uint64_t i = first; i < head; ++i) {
+            Event& event = buffer->events[i & (EVENTS_PER_THREAD - 1)];
+            const char* name = event.name.load(memory_order_relaxed);
+            uint64_t start = event.start_ticks.load(memory_order_relaxed);
+            uint64_t end = event.end_ticks.load(memory_order_relaxed);
+            if (!name || start < session_start || end < start) continue;
+
+            out << (written ? "," : "")
+                << "{\"name\":\"" << name << "\",\"cat\":\"deribit\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << clock.to_nanoseconds(start - session_start) / 1000.0
+                << ",\"dur\":" << clock.to_nanoseconds(end - start) / 1000.0 << "}";
+            ++written;
+        }
+    }
+
+    out << "]}\n";
+    if (!out) {
+        error = "write to " + path + " failed";
+        return -1;
+    }
+    return written;
+}
+
+Tracer& getTracer() {
+    static Tracer tracer;
+    return tracer;
+}
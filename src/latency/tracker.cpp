@@ -3,54 +3,280 @@
 
 using namespace std;
 
-void LatencyTracker::start_measurement(LatencyType type, const string& unique_id) {
-    lock_guard<mutex> lock(metrics_mutex);
-    
-    LatencyMetric metric;
-    metric.start_time = chrono::high_resolution_clock::now();
-    
-    if (unique_id.empty()) {
-        latency_metrics[type].push_back(metric);
-    } else {
-        active_measurements[unique_id] = metric;
+static const char* type_names[] = {
+    "Order Placement",
+    "Market Data Processing",
+    "WebSocket Message Propagation",
+    "Trading Loop End-to-End",
+    "Request Round-Trip",
+    "Exchange-to-Local Feed",
+    "Reconnect to First Tick",
+    "Heartbeat RTT",
+    "Connection Setup"
+};
+
+LatencyTracker::LatencyTracker() :
+    recorder_count(0),
+    reset_epoch(0),
+    dropped_samples(0),
+    series_count(LATENCY_TYPE_COUNT),
+    next_handle(1)
+{
+    for (auto& r : recorders) {
+        r.store(nullptr, memory_order_relaxed);
+    }
+    for (auto& interval : expected_interval_ns) {
+        interval.store(0, memory_order_relaxed);
     }
 }
 
-void LatencyTracker::stop_measurement(LatencyType type, const string& unique_id) {
-    lock_guard<mutex> lock(metrics_mutex);
-    auto end_time = chrono::high_resolution_clock::now();
-    
-    if (unique_id.empty()) {
-        // Find the most recent uncompleted metric for this type
-        for (auto& metric : latency_metrics[type]) {
-            if (!metric.completed) {
-                metric.end_time = end_time;
-                metric.duration = chrono::duration_cast<chrono::nanoseconds>(
-                    metric.end_time - metric.start_time
-                );
-                metric.completed = true;
-                break;
-            }
+LatencyTracker::~LatencyTracker() {
+    for (auto& r : recorders) {
+        delete r.load(memory_order_acquire);
+    }
+}
+
+LatencyTracker::ThreadRecorder* LatencyTracker::local_recorder() {
+    struct cached_recorder {
+        LatencyTracker* owner = nullptr;
+        ThreadRecorder* recorder = nullptr;
+
+        // The recorder outlives the thread, samples and all; the next new
+        // thread takes it over
+        ~cached_recorder() {
+            if (recorder) recorder->in_use.store(false, memory_order_release);
+        }
+    };
+    thread_local cached_recorder cache;
+
+    if (cache.owner == this) {
+        return cache.recorder;
+    }
+
+    if (cache.recorder) cache.recorder->in_use.store(false, memory_order_release);
+    cache.owner = this;
+    cache.recorder = claim_recorder();
+    return cache.recorder;
+}
+
+// A recorder left behind by an exited thread, else a new one in a free
+// slot; nullptr once MAX_RECORDER_THREADS threads are recording at once
+LatencyTracker::ThreadRecorder* LatencyTracker::claim_recorder() {
+    int count = min(recorder_count.load(memory_order_acquire), MAX_RECORDER_THREADS);
+    for (int i = 0; i < count; ++i) {
+        ThreadRecorder* recorder = recorders[i].load(memory_order_acquire);
+        bool in_use = false;
+        if (recorder && recorder->in_use.compare_exchange_strong(in_use, true, memory_order_acq_rel)) {
+            return recorder;
+        }
+    }
+
+    int slot = recorder_count.fetch_add(1, memory_order_acq_rel);
+    if (slot >= MAX_RECORDER_THREADS) return nullptr;
+
+    ThreadRecorder* recorder = new ThreadRecorder();
+    recorder->epoch.store(reset_epoch.load(memory_order_acquire), memory_order_relaxed);
+    recorders[slot].store(recorder, memory_order_release);
+    return recorder;
+}
+
+int LatencyTracker::register_series(LatencyType type, const string& label) {
+    int count = series_count.load(memory_order_acquire);
+    for (int i = LATENCY_TYPE_COUNT; i < count; ++i) {
+        if (series_info[i].parent == type && series_info[i].label == label) return i;
+    }
+
+    lock_guard<mutex> lock(registry_mutex);
+    // Another thread may have registered it while we waited
+    count = series_count.load(memory_order_acquire);
+    for (int i = LATENCY_TYPE_COUNT; i < count; ++i) {
+        if (series_info[i].parent == type && series_info[i].label == label) return i;
+    }
+    if (count >= MAX_SERIES) return type;
+
+    series_info[count].parent = type;
+    series_info[count].label = label;
+    series_count.store(count + 1, memory_order_release);
+    return count;
+}
+
+void LatencyTracker::record_one(ThreadRecorder* recorder, int series, uint64_t ns) {
+    recorder->histograms[series].record(ns);
+
+    LatencyType type = static_cast<LatencyType>(series);
+    if (series >= LATENCY_TYPE_COUNT) {
+        type = series_info[series].parent;
+        recorder->histograms[type].record(ns);
+    }
+    recorder->windows[type].record(ns);
+}
+
+LatencyTracker::ThreadRecorder* LatencyTracker::current_recorder() {
+    ThreadRecorder* recorder = local_recorder();
+    if (!recorder) {
+        dropped_samples.fetch_add(1, memory_order_relaxed);
+        return nullptr;
+    }
+
+    uint32_t epoch = reset_epoch.load(memory_order_acquire);
+    if (recorder->epoch.load(memory_order_relaxed) != epoch) {
+        for (auto& histogram : recorder->histograms) {
+            if (!histogram.empty()) histogram.clear();
         }
-    } else {
-        // Find the specific measurement by unique ID
-        auto it = active_measurements.find(unique_id);
-        if (it != active_measurements.end()) {
-            it->second.end_time = end_time;
-            it->second.duration = chrono::duration_cast<chrono::nanoseconds>(
-                it->second.end_time - it->second.start_time
-            );
-            it->second.completed = true;
-            
-            latency_metrics[type].push_back(it->second);
-            active_measurements.erase(it);
+        for (auto& window : recorder->windows) {
+            window.clear();
         }
+        for (auto& c : recorder->event_counts) {
+            c.store(0, memory_order_relaxed);
+        }
+        recorder->epoch.store(epoch, memory_order_release);
+    }
+    return recorder;
+}
+
+void LatencyTracker::record(int series, chrono::nanoseconds duration) {
+    ThreadRecorder* recorder = current_recorder();
+    if (!recorder) return;
+
+    record_one(recorder, series, duration.count() > 0 ? duration.count() : 0);
+}
+
+void LatencyTracker::count_event(int series) {
+    ThreadRecorder* recorder = current_recorder();
+    if (!recorder) return;
+
+    atomic<uint64_t>& counter = recorder->event_counts[series];
+    counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    if (series >= LATENCY_TYPE_COUNT) {
+        atomic<uint64_t>& parent = recorder->event_counts[series_info[series].parent];
+        parent.store(parent.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyTracker::get_event_count(int series) {
+    uint64_t total = 0;
+    uint32_t epoch = reset_epoch.load(memory_order_acquire);
+
+    for (auto& r : recorders) {
+        ThreadRecorder* recorder = r.load(memory_order_acquire);
+        if (!recorder || recorder->epoch.load(memory_order_acquire) != epoch) continue;
+        total += recorder->event_counts[series].load(memory_order_relaxed);
+    }
+    return total;
+}
+
+LatencyTracker::Handle LatencyTracker::start_measurement(int series) {
+    // Set on a slot's handle while its fields are being rewritten
+    const uint64_t writing_bit = 1ull << 63;
+
+    Handle handle = next_handle.fetch_add(1, memory_order_relaxed);
+    PendingSlot& slot = pending[handle & (MAX_PENDING_MEASUREMENTS - 1)];
+
+    // Claim the slot, invalidating whatever stale measurement still owns it.
+    // If another thread is mid-write here the table has wrapped under us;
+    // give up on this sample rather than wait.
+    uint64_t current = slot.handle.load(memory_order_acquire);
+    if ((current & writing_bit) ||
+        !slot.handle.compare_exchange_strong(current, handle | writing_bit, memory_order_acq_rel)) {
+        dropped_samples.fetch_add(1, memory_order_relaxed);
+        return 0;
+    }
+    if (current != 0) {
+        // A measurement that was never stopped is being recycled
+        dropped_samples.fetch_add(1, memory_order_relaxed);
+    }
+
+    slot.series.store(series, memory_order_relaxed);
+    slot.start_ticks.store(clock.start_ticks(), memory_order_relaxed);
+    slot.handle.store(handle, memory_order_release);
+
+    return handle;
+}
+
+void LatencyTracker::stop_measurement(Handle handle, uint64_t end_ticks) {
+    if (end_ticks == 0) end_ticks = clock.stop_ticks();
+
+    PendingSlot& slot = pending[handle & (MAX_PENDING_MEASUREMENTS - 1)];
+    if (handle == 0 || slot.handle.load(memory_order_acquire) != handle) return;
+
+    uint64_t start_ticks = slot.start_ticks.load(memory_order_relaxed);
+    int series = slot.series.load(memory_order_relaxed);
+
+    // Only the first stop for a handle wins; a stale or repeated one is ignored
+    if (!slot.handle.compare_exchange_strong(handle, 0, memory_order_acq_rel)) return;
+
+    // TSC readings taken on different cores can be a few ticks out of order
+    uint64_t elapsed = end_ticks > start_ticks ? end_ticks - start_ticks : 0;
+    record(series, chrono::nanoseconds(clock.to_nanoseconds(elapsed)));
+}
+
+void LatencyTracker::cancel_measurement(Handle handle) {
+    if (handle == 0) return;
+    PendingSlot& slot = pending[handle & (MAX_PENDING_MEASUREMENTS - 1)];
+    slot.handle.compare_exchange_strong(handle, 0, memory_order_acq_rel);
+}
+
+void LatencyTracker::set_expected_interval(LatencyType type, chrono::nanoseconds interval) {
+    expected_interval_ns[type].store(interval.count() > 0 ? interval.count() : 0, memory_order_relaxed);
+}
+
+chrono::nanoseconds LatencyTracker::get_expected_interval(LatencyType type) const {
+    return chrono::nanoseconds(expected_interval_ns[type].load(memory_order_relaxed));
+}
+
+HistogramSnapshot LatencyTracker::get_corrected_snapshot(LatencyType type, uint64_t& in_flight) {
+    HistogramSnapshot snapshot = get_snapshot(type);
+
+    // Requests that have not been answered yet are at least as slow as
+    // their age; leaving them out would flatter the tail.
+    in_flight = 0;
+    uint64_t now = clock.stop_ticks();
+    for (auto& slot : pending) {
+        uint64_t handle = slot.handle.load(memory_order_acquire);
+        if (handle == 0 || (handle >> 63)) continue;
+
+        int series = slot.series.load(memory_order_relaxed);
+        uint64_t start_ticks = slot.start_ticks.load(memory_order_relaxed);
+        if (slot.handle.load(memory_order_acquire) != handle) continue;
+
+        LatencyType parent = series < LATENCY_TYPE_COUNT
+            ? static_cast<LatencyType>(series) : series_info[series].parent;
+        if (parent != type) continue;
+
+        snapshot.record(now > start_ticks ? clock.to_nanoseconds(now - start_ticks) : 0);
+        ++in_flight;
+    }
+
+    return snapshot.corrected_for_coordinated_omission(expected_interval_ns[type].load(memory_order_relaxed));
+}
+
+HistogramSnapshot LatencyTracker::get_snapshot(int series) {
+    HistogramSnapshot snapshot;
+    uint32_t epoch = reset_epoch.load(memory_order_acquire);
+
+    for (auto& r : recorders) {
+        ThreadRecorder* recorder = r.load(memory_order_acquire);
+        // Recorders that have not yet seen the latest reset hold stale data
+        if (!recorder || recorder->epoch.load(memory_order_acquire) != epoch) continue;
+        recorder->histograms[series].merge_into(snapshot);
+    }
+    return snapshot;
+}
+
+HistogramSnapshot LatencyTracker::get_window_snapshot(LatencyType type, int seconds) {
+    HistogramSnapshot snapshot;
+    uint32_t epoch = reset_epoch.load(memory_order_acquire);
+    uint64_t now = RollingWindow::now_ns();
+
+    for (auto& r : recorders) {
+        ThreadRecorder* recorder = r.load(memory_order_acquire);
+        if (!recorder || recorder->epoch.load(memory_order_acquire) != epoch) continue;
+        recorder->windows[type].merge_into(snapshot, seconds, now);
     }
+    return snapshot;
 }
 
 string LatencyTracker::generate_report() {
-    lock_guard<mutex> lock(metrics_mutex);
-    
     int terminal_width = utils::getTerminalWidth();
     
     ostringstream report;
@@ -68,47 +294,35 @@ string LatencyTracker::generate_report() {
     
     report << header_color << padding << header << padding << reset_color << "\n\n";
 
-    const char* type_names[] = {
-        "Order Placement",
-        "Market Data Processing", 
-        "WebSocket Message Propagation", 
-        "Trading Loop End-to-End"
-    };
+    report << metric_color << "Clock: " << reset_color << clock.describe() << "\n\n";
 
     // Define column widths based on terminal width
     int type_col_width = 30;
     int metric_col_width = (terminal_width - type_col_width - 4) / 2;
 
-    for (int type = 0; type < 4; ++type) {
-        auto metrics = latency_metrics[static_cast<LatencyType>(type)];
-        
-        if (metrics.empty()) continue;
+    for (int type = 0; type < LATENCY_TYPE_COUNT; ++type) {
+        HistogramSnapshot snapshot = get_snapshot(static_cast<LatencyType>(type));
 
-        // Calculate statistics
-        vector<chrono::nanoseconds> durations;
-        for (const auto& metric : metrics) {
-            if (metric.completed) {
-                durations.push_back(metric.duration);
+        if (snapshot.count() == 0) {
+            // Builds with counter-only instrumentation count without timing
+            uint64_t events = get_event_count(type);
+            if (events > 0) {
+                report << section_color << left << setw(type_col_width) << type_names[type] << reset_color
+                       << right << "  " << metric_color << "Events: " << reset_color << events
+                       << " (counters only)\n\n";
             }
-        }
-
-        if (durations.empty()) {
-            report << section_color << type_names[type] << reset_color
-                   << " Latency: No completed measurements\n\n";
             continue;
         }
 
-        sort(durations.begin(), durations.end());
-
-        auto total_measurements = durations.size();
-        auto mean_duration = accumulate(durations.begin(), durations.end(), 
-            chrono::nanoseconds(0)) / total_measurements;
+        auto total_measurements = snapshot.count();
+        auto mean_duration = snapshot.mean();
 
-        auto percentile_50 = durations[total_measurements * 0.5];
-        auto percentile_90 = durations[total_measurements * 0.9];
-        auto percentile_99 = durations[total_measurements * 0.99];
-        auto min_duration = durations.front();
-        auto max_duration = durations.back();
+        auto percentile_50 = snapshot.value_at_quantile(0.5);
+        auto percentile_90 = snapshot.value_at_quantile(0.9);
+        auto percentile_99 = snapshot.value_at_quantile(0.99);
+        auto percentile_999 = snapshot.value_at_quantile(0.999);
+        auto min_duration = snapshot.min();
+        auto max_duration = snapshot.max();
 
         report << section_color << left << setw(type_col_width) << type_names[type] 
                << reset_color
@@ -117,19 +331,57 @@ string LatencyTracker::generate_report() {
         
         // First column of metrics
         report << "  " << metric_color << "Meas: " << reset_color << setw(6) << total_measurements 
-               << "  " << metric_color << "Mean: " << reset_color << setw(8) << mean_duration.count() / 1000.0 << " µs\n";
+               << "  " << metric_color << "Mean: " << reset_color << setw(8) << mean_duration / 1000.0 << " µs\n";
         
         // Padding for alignment
         report << string(type_col_width, ' ');
         
         // Second column of metrics
-        report << "  " << metric_color << "Min:  " << reset_color << setw(8) << min_duration.count() / 1000.0 << " µs"
-               << "  " << metric_color << "Max:  " << reset_color << setw(8) << max_duration.count() / 1000.0 << " µs\n";
+        report << "  " << metric_color << "Min:  " << reset_color << setw(8) << min_duration / 1000.0 << " µs"
+               << "  " << metric_color << "Max:  " << reset_color << setw(8) << max_duration / 1000.0 << " µs\n";
         
         report << string(type_col_width, ' ')
-               << "  " << metric_color << "50th: " << reset_color << setw(8) << percentile_50.count() / 1000.0 << " µs"
-               << "  " << metric_color << "90th: " << reset_color << setw(8) << percentile_90.count() / 1000.0 << " µs"
-               << "  " << metric_color << "99th: " << reset_color << setw(8) << percentile_99.count() / 1000.0 << " µs\n\n";
+               << "  " << metric_color << "50th: " << reset_color << setw(8) << percentile_50 / 1000.0 << " µs"
+               << "  " << metric_color << "90th: " << reset_color << setw(8) << percentile_90 / 1000.0 << " µs"
+               << "  " << metric_color << "99th: " << reset_color << setw(8) << percentile_99 / 1000.0 << " µs"
+               << "  " << metric_color << "99.9th: " << reset_color << setw(8) << percentile_999 / 1000.0 << " µs\n";
+
+        uint64_t interval = expected_interval_ns[type].load(memory_order_relaxed);
+        if (interval > 0) {
+            uint64_t in_flight = 0;
+            HistogramSnapshot corrected = get_corrected_snapshot(static_cast<LatencyType>(type), in_flight);
+
+            report << string(type_col_width, ' ')
+                   << "  " << metric_color << "CO-corrected @ " << interval / 1000.0 << " µs: " << reset_color
+                   << "99th " << corrected.value_at_quantile(0.99) / 1000.0 << " µs"
+                   << "  99.9th " << corrected.value_at_quantile(0.999) / 1000.0 << " µs"
+                   << "  Max " << corrected.max() / 1000.0 << " µs"
+                   << "  Unanswered " << in_flight << "\n";
+        }
+
+        // Labelled breakdown, e.g. round-trip per JSON-RPC method
+        int count = series_count.load(memory_order_acquire);
+        for (int series = LATENCY_TYPE_COUNT; series < count; ++series) {
+            if (series_info[series].parent != type) continue;
+
+            HistogramSnapshot sub = get_snapshot(series);
+            if (sub.count() == 0) continue;
+
+            report << "  " << left << setw(type_col_width - 2) << series_info[series].label << right
+                   << "  " << metric_color << "Meas: " << reset_color << setw(6) << sub.count()
+                   << "  " << metric_color << "50th: " << reset_color << setw(8) << sub.value_at_quantile(0.5) / 1000.0 << " µs"
+                   << "  " << metric_color << "99th: " << reset_color << setw(8) << sub.value_at_quantile(0.99) / 1000.0 << " µs"
+                   << "  " << metric_color << "Max: " << reset_color << setw(8) << sub.max() / 1000.0 << " µs\n";
+        }
+        report << "\n";
+    }
+
+    report << generate_window_report() << "\n";
+
+    uint64_t dropped = dropped_samples.load(memory_order_relaxed);
+    if (dropped > 0) {
+        report << metric_color << "Dropped samples: " << reset_color
+               << dropped << "\n\n";
     }
 
     report << footer_color << string(terminal_width, '=') << reset_color << "\n";
@@ -137,16 +389,129 @@ string LatencyTracker::generate_report() {
     return report.str();
 }
 
+string LatencyTracker::generate_window_report() {
+    ostringstream report;
+
+    const string reset_color = "\033[0m";
+    const string section_color = "\033[1;32m"; // Bold Green
+    const string metric_color = "\033[1;33m"; // Bold Yellow
 
-map<LatencyTracker::LatencyType, vector<LatencyTracker::LatencyMetric>> LatencyTracker::get_raw_metrics() {
-    lock_guard<mutex> lock(metrics_mutex);
-    return latency_metrics;
+    const int window_seconds[] = { 10, 60, RollingWindow::MAX_WINDOW_SECONDS };
+    const char* window_names[] = { "Last 10s (µs)", "Last 1m (µs)", "Last 5m (µs)" };
+
+    int type_col_width = 30;
+    // count, p50 and p99 (µs) for each window
+    int window_col_width = 28;
+
+    report << section_color << left << setw(type_col_width) << "Rolling Windows" << reset_color << right;
+    for (const char* name : window_names) {
+        // +1 for the two-byte µ, which setw counts as two columns
+        report << "  " << metric_color << left << setw(window_col_width + 1) << name << right << reset_color;
+    }
+    report << "\n" << string(type_col_width, ' ');
+    for (size_t i = 0; i < sizeof(window_names) / sizeof(window_names[0]); ++i) {
+        report << "  " << setw(7) << "Meas" << setw(10) << "50th" << setw(11) << "99th";
+    }
+    report << "\n";
+
+    bool any = false;
+    for (int type = 0; type < LATENCY_TYPE_COUNT; ++type) {
+        const size_t window_count = sizeof(window_seconds) / sizeof(window_seconds[0]);
+        HistogramSnapshot snapshots[window_count];
+        for (size_t i = 0; i < window_count; ++i) {
+            snapshots[i] = get_window_snapshot(static_cast<LatencyType>(type), window_seconds[i]);
+        }
+        // Types with nothing in the longest window are left out
+        if (snapshots[window_count - 1].count() == 0) continue;
+        any = true;
+
+        report << left << setw(type_col_width) << type_names[type] << right << fixed << setprecision(3);
+        for (HistogramSnapshot const &snapshot : snapshots) {
+            report << "  " << setw(7) << snapshot.count()
+                   << setw(10) << snapshot.value_at_quantile(0.5) / 1000.0
+                   << setw(11) << snapshot.value_at_quantile(0.99) / 1000.0;
+        }
+        report << "\n";
+    }
+    if (!any) {
+        report << "  (no samples in the last 5 minutes)\n";
+    }
+
+    return report.str();
+}
+
+void LatencyTracker::write_openmetrics(ostream& out) {
+    const char* type_labels[] = {
+        "order_placement",
+        "market_data_processing",
+        "websocket_message_propagation",
+        "trading_loop_end_to_end",
+        "request_round_trip",
+        "feed_latency",
+        "reconnect_to_first_tick",
+        "heartbeat_rtt",
+        "connection_setup"
+    };
+
+    // Exposition bounds in seconds; the histogram itself is much finer
+    const double bounds[] = {
+        1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+        1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+    };
+
+    out << "# HELP deribit_latency_seconds Latency measured by LatencyTracker\n"
+        << "# TYPE deribit_latency_seconds histogram\n";
+
+    int count = series_count.load(memory_order_acquire);
+    for (int series = 0; series < count; ++series) {
+        HistogramSnapshot snapshot = get_snapshot(series);
+        if (snapshot.count() == 0) continue;
+
+        string labels;
+        if (series < LATENCY_TYPE_COUNT) {
+            labels = string("type=\"") + type_labels[series] + "\"";
+        } else {
+            labels = string("type=\"") + type_labels[series_info[series].parent] + "\",label=\"" +
+                     utils::openmetrics_label(series_info[series].label) + "\"";
+        }
+
+        for (double bound : bounds) {
+            out << "deribit_latency_seconds_bucket{" << labels << ",le=\"" << bound << "\"} "
+                << snapshot.count_at_or_below(static_cast<uint64_t>(bound * 1e9)) << "\n";
+        }
+        out << "deribit_latency_seconds_bucket{" << labels << ",le=\"+Inf\"} " << snapshot.count() << "\n"
+            << "deribit_latency_seconds_sum{" << labels << "} " << snapshot.sum() / 1e9 << "\n"
+            << "deribit_latency_seconds_count{" << labels << "} " << snapshot.count() << "\n";
+    }
+
+    out << "# HELP deribit_latency_events_total Events counted by counter-only instrumentation\n"
+        << "# TYPE deribit_latency_events_total counter\n";
+    for (int type = 0; type < LATENCY_TYPE_COUNT; ++type) {
+        uint64_t events = get_event_count(type);
+        if (events > 0) {
+            out << "deribit_latency_events_total{type=\"" << type_labels[type] << "\"} " << events << "\n";
+        }
+    }
+
+    out << "# HELP deribit_latency_dropped_samples_total Measurements that could not be recorded\n"
+        << "# TYPE deribit_latency_dropped_samples_total counter\n"
+        << "deribit_latency_dropped_samples_total " << dropped_samples.load(memory_order_relaxed) << "\n";
+}
+
+bool LatencyTracker::set_clock_source(LatencyClock::Source source) {
+    if (!clock.set_source(source)) return false;
+    for (auto& slot : pending) {
+        slot.handle.store(0, memory_order_release);
+    }
+    return true;
 }
 
 void LatencyTracker::reset() {
-    lock_guard<mutex> lock(metrics_mutex);
-    latency_metrics.clear();
-    active_measurements.clear();
+    reset_epoch.fetch_add(1, memory_order_acq_rel);
+    dropped_samples.store(0, memory_order_relaxed);
+    for (auto& slot : pending) {
+        slot.handle.store(0, memory_order_release);
+    }
 
     int terminal_width = utils::getTerminalWidth();
 
@@ -162,4 +527,4 @@ void LatencyTracker::reset() {
 LatencyTracker& getLatencyTracker() {
     static LatencyTracker tracker;
     return tracker;
-}
\ No newline at end of file
+}
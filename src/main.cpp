@@ -11,15 +11,46 @@
 #include "utils/utils.h"
 
 #include "latency/tracker.h"
+#include "latency/trace.h"
+#include "metrics/exporter.h"
 
 using namespace std;
 
+// How long the prompt waits for a request's response before moving on
+static const int REQUEST_TIMEOUT_SECONDS = 10;
+
+static const size_t MESSAGES_PER_PAGE = 20;
+
 int main() {
     bool done = false;
     char* input;
     
     websocket_endpoint endpoint;
 
+    // Construct the tracker up front so TSC calibration doesn't land in the
+    // first measurement
+    getLatencyTracker();
+    getTracer().set_thread_name("repl");
+
+    MetricsExporter exporter;
+    exporter.add_collector([](ostream &out) { getLatencyTracker().write_openmetrics(out); });
+    exporter.add_collector([&endpoint](ostream &out) { endpoint.write_openmetrics(out); });
+
+    // Blocks the prompt until a request's own response has been printed
+    auto await_response = [](future<json> &response) {
+        if (!response.valid()) return;
+        if (response.wait_for(chrono::seconds(REQUEST_TIMEOUT_SECONDS)) == future_status::timeout) {
+            fmt::print(fg(fmt::color::yellow),
+                       "> No response after {}s; it will be shown when it arrives\n", REQUEST_TIMEOUT_SECONDS);
+            return;
+        }
+        json reply = response.get();
+        if (reply.contains("error") && reply["error"].contains("code") && reply["error"]["code"] == connection_metadata::REQUEST_CANCELLED) {
+            fmt::print(fg(fmt::color::red) | fmt::emphasis::bold, "> Request failed: {}\n",
+                       reply["error"].value("message", "unknown error"));
+        }
+    };
+
     utils::printHeader();
               
     while (!done) {
@@ -49,10 +80,22 @@ int main() {
             // Check if URI is provided
             if (command.length() <= 8) {
                 fmt::print(fg(fmt::color::red) | fmt::emphasis::bold, 
-                           "Error: Missing URI. Usage: connect <URI>\n");
+                           "Error: Missing URI. Usage: connect <URI> [market|trading] [deflate]\n");
             } else {
-                string uri = command.substr(8);
-                int id = endpoint.connect(uri);
+                stringstream ss(command.substr(8));
+                string uri;
+                string role_name;
+                string option;
+                io_role role = IO_ROLE_TRADING;
+
+                ss >> uri >> role_name >> option;
+                if (!role_name.empty() && !websocket_endpoint::parse_io_role(role_name, role)) {
+                    fmt::print(fg(fmt::color::yellow), "> Unknown role \"{}\", using trading\n", role_name);
+                }
+                if (!option.empty() && option != "deflate") {
+                    fmt::print(fg(fmt::color::yellow), "> Unknown option \"{}\" ignored\n", option);
+                }
+                int id = endpoint.connect(uri, role, option == "deflate");
         
                 if (id != -1) {
                     fmt::print(fg(fmt::color::green) | fmt::emphasis::bold, 
@@ -67,26 +110,38 @@ int main() {
             }
         }
         else if (command.substr(0, 13) == "show_messages") {
-            // Show messages for a specific connection
+            // Show one page of the retained messages for a connection;
+            // defaults to the newest page
             stringstream ss(command);
             string cmd;
             int id;
+            size_t page = 0;
 
             ss >> cmd >> id;
 
             if (ss.fail()) {
                 fmt::print(fg(fmt::color::red) | fmt::emphasis::bold, 
-                           "Error: Missing connection ID. Usage: show_messages <connection_id>\n");
+                           "Error: Missing connection ID. Usage: show_messages <connection_id> [page]\n");
             } else {
+                bool has_page = static_cast<bool>(ss >> page);
                 connection_metadata::ptr metadata = endpoint.get_metadata(id);
 
                 if (metadata) {
-                    if (metadata->m_messages.empty()) {
+                    message_history &history = metadata->get_messages();
+                    size_t retained = history.size();
+
+                    if (retained == 0) {
                         fmt::print(fg(fmt::color::yellow), "> No messages for connection {}\n", id);
                     } else {
-                        for (const auto& msg : metadata->m_messages) {
-                            cout << msg << "\n\n";
+                        size_t pages = (retained + MESSAGES_PER_PAGE - 1) / MESSAGES_PER_PAGE;
+                        if (!has_page || page < 1 || page > pages) page = pages;
+
+                        for (const auto& msg : history.page((page - 1) * MESSAGES_PER_PAGE, MESSAGES_PER_PAGE)) {
+                            cout << "#" << msg.seq << " " << msg.text << "\n\n";
                         }
+                        fmt::print(fg(fmt::color::cyan), "> Page {} of {} ({} retained, {} older evicted{})\n",
+                                   page, pages, retained, history.evicted(),
+                                   history.spill_file().empty() ? "" : " to " + history.spill_file());
                     }
                 } else {
                     fmt::print(fg(fmt::color::red) | fmt::emphasis::bold, 
@@ -94,12 +149,251 @@ int main() {
                 }
             }
         }
+        else if (command.substr(0, 13) == "history_spill") {
+            stringstream ss(command);
+            string cmd;
+            int id;
+            string path;
+
+            ss >> cmd >> id >> path;
+
+            connection_metadata::ptr metadata;
+            if (!ss.fail()) metadata = endpoint.get_metadata(id);
+
+            string error;
+            if (ss.fail()) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "Error: Usage: history_spill <connection_id> <file.gz>|off\n");
+            } else if (!metadata) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold, "> Unknown connection id {}\n", id);
+            } else if (!metadata->get_messages().set_spill_file(path == "off" ? "" : path, error)) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold, "> {}\n", error);
+            } else if (path == "off") {
+                fmt::print(fg(fmt::color::yellow), "> Evicted messages of connection {} are discarded\n", id);
+            } else {
+                fmt::print(fg(fmt::color::green), "> Evicted messages of connection {} are compressed to {}\n", id, path);
+            }
+        }
+        else if (command == "pool" || command.substr(0, 5) == "pool ") {
+            // pool | pool <URI> <count> [market|trading] | pool off [market|trading]
+            stringstream ss(command);
+            string cmd;
+            string uri;
+            long count = 0;
+            string role_name;
+            io_role role = IO_ROLE_TRADING;
+
+            ss >> cmd >> uri;
+            if (uri != "off") ss >> count;
+            ss >> role_name;
+
+            if (uri.empty()) {
+                for (int r = 0; r < IO_ROLE_COUNT; ++r) {
+                    fmt::print(fg(fmt::color::cyan), "> {} spares: {}\n", websocket_endpoint::io_role_name(io_role(r)),
+                               endpoint.describe_spare_pool(io_role(r)));
+                }
+            } else if ((uri != "off" && (ss.fail() || count < 0)) ||
+                       (!role_name.empty() && !websocket_endpoint::parse_io_role(role_name, role))) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "Error: Usage: pool [<URI> <count>|off] [market|trading]\n");
+            } else {
+                endpoint.set_spare_pool(role, uri == "off" ? "" : uri, uri == "off" ? 0 : count);
+                fmt::print(fg(fmt::color::green), "> {} spares: {}\n", websocket_endpoint::io_role_name(role),
+                           endpoint.describe_spare_pool(role));
+            }
+        }
+        else if (command.substr(0, 14) == "auto_reconnect") {
+            stringstream ss(command);
+            string cmd;
+            int id;
+            string value;
+
+            ss >> cmd >> id >> value;
+
+            connection_metadata::ptr metadata;
+            if (!ss.fail()) metadata = endpoint.get_metadata(id);
+
+            if (ss.fail() || (value != "on" && value != "off")) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "Error: Usage: auto_reconnect <connection_id> on|off\n");
+            } else if (!metadata) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold, "> Unknown connection id {}\n", id);
+            } else {
+                metadata->set_auto_reconnect(value == "on");
+                fmt::print(fg(fmt::color::green), "> Auto-reconnect {} for connection {}\n", value, id);
+            }
+        }
+        else if (command.substr(0, 13) == "latency_watch") {
+            stringstream ss(command);
+            string cmd;
+            string value;
+
+            ss >> cmd >> value;
+
+            int interval_ms = 1000;
+            stringstream value_ss(value);
+
+            // Refreshing faster than 100 ms only adds flicker
+            if (!value.empty() && (!(value_ss >> interval_ms) || interval_ms < 100)) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "Error: Invalid interval. Usage: latency_watch [interval_ms >= 100]\n");
+            } else {
+                utils::watch_console([]() { return getLatencyTracker().generate_window_report(); }, interval_ms);
+            }
+        }
+        else if (command.substr(0, 16) == "latency_interval") {
+            stringstream ss(command);
+            string cmd;
+            string value;
+
+            ss >> cmd >> value;
+
+            chrono::nanoseconds interval = getLatencyTracker().get_expected_interval(LatencyTracker::REQUEST_ROUND_TRIP);
+            double interval_ms = 0;
+            stringstream value_ss(value);
+
+            if (value == "off") {
+                interval = chrono::nanoseconds(0);
+            } else if (!value.empty() && (value_ss >> interval_ms) && interval_ms > 0) {
+                interval = chrono::duration_cast<chrono::nanoseconds>(
+                    chrono::duration<double, milli>(interval_ms));
+            } else if (!value.empty()) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "Error: Invalid interval. Usage: latency_interval [ms|off]\n");
+            }
+            getLatencyTracker().set_expected_interval(LatencyTracker::REQUEST_ROUND_TRIP, interval);
+
+            if (interval.count() > 0) {
+                fmt::print(fg(fmt::color::cyan), "> Round-trip coordinated-omission correction: every {} ms\n",
+                           interval.count() / 1e6);
+            } else {
+                fmt::print(fg(fmt::color::cyan), "> Round-trip coordinated-omission correction: off\n");
+            }
+        }
+        else if (command.substr(0, 9) == "io_thread") {
+            // io_thread [market|trading] [cpu <n>|none] [fifo <priority>|off] [busy_poll <idle_us>|off]
+            stringstream ss(command);
+            string cmd;
+            string role_name;
+
+            ss >> cmd >> role_name;
+
+            io_role role;
+            if (role_name.empty()) {
+                for (int r = 0; r < IO_ROLE_COUNT; ++r) {
+                    fmt::print(fg(fmt::color::cyan), "> {}\n", endpoint.describe_io_thread(static_cast<io_role>(r)));
+                }
+            } else if (!websocket_endpoint::parse_io_role(role_name, role)) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "Error: Usage: io_thread [market|trading] [cpu <n>|none] [fifo <priority>|off] [busy_poll <idle_us>|off]\n");
+            } else {
+                // Options not given keep their current setting
+                io_thread_config config = endpoint.get_io_thread_config(role);
+                string option;
+                string value;
+                bool valid = true;
+
+                while (valid && ss >> option >> value) {
+                    if (option == "cpu") {
+                        config.cpu = value == "none" ? -1 : atoi(value.c_str());
+                    } else if (option == "fifo") {
+                        config.fifo_priority = value == "off" ? 0 : atoi(value.c_str());
+                    } else if (option == "busy_poll") {
+                        config.busy_poll_us = value == "off" ? -1 : atol(value.c_str());
+                    } else {
+                        valid = false;
+                    }
+                }
+
+                string error;
+                if (!valid) {
+                    fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                               "Error: Usage: io_thread [market|trading] [cpu <n>|none] [fifo <priority>|off] [busy_poll <idle_us>|off]\n");
+                } else if (!endpoint.set_io_thread_config(role, config, error)) {
+                    fmt::print(fg(fmt::color::red) | fmt::emphasis::bold, "> {}\n", error);
+                } else {
+                    fmt::print(fg(fmt::color::green), "> {}\n", endpoint.describe_io_thread(role));
+                }
+            }
+        }
         else if (command.substr(0, 14) == "latency_report") {
             cout << getLatencyTracker().generate_report() << endl;
         }
         else if (command.substr(0, 12) == "reset_report") {
             getLatencyTracker().reset();
         }
+        else if (command.substr(0, 13) == "latency_clock") {
+            stringstream ss(command);
+            string cmd;
+            string source;
+
+            ss >> cmd >> source;
+
+            if (source.empty()) {
+                fmt::print(fg(fmt::color::cyan), "> Latency clock: {}\n",
+                           getLatencyTracker().get_clock().describe());
+            } else if (source != "tsc" && source != "steady") {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "Error: Unknown clock. Usage: latency_clock [tsc|steady]\n");
+            } else if (!getLatencyTracker().set_clock_source(
+                           source == "tsc" ? LatencyClock::TSC : LatencyClock::STEADY)) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "> Invariant TSC not available on this CPU\n");
+            } else {
+                fmt::print(fg(fmt::color::green), "> Latency clock: {}\n",
+                           getLatencyTracker().get_clock().describe());
+            }
+        }
+        else if (command == "trace_start") {
+            getTracer().start();
+            fmt::print(fg(fmt::color::green), "> Tracing started\n");
+        }
+        else if (command == "trace_stop") {
+            getTracer().stop();
+            fmt::print(fg(fmt::color::yellow), "> Tracing stopped\n");
+        }
+        else if (command.substr(0, 10) == "trace_dump") {
+            stringstream ss(command);
+            string cmd;
+            string path;
+            string error;
+
+            ss >> cmd >> path;
+
+            if (path.empty()) {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "Error: Missing file. Usage: trace_dump <file>\n");
+            } else {
+                long events = getTracer().dump(path, error);
+                if (events < 0) {
+                    fmt::print(fg(fmt::color::red) | fmt::emphasis::bold, "> Trace dump failed: {}\n", error);
+                } else {
+                    fmt::print(fg(fmt::color::green),
+                               "> Wrote {} trace events to {} (open in ui.perfetto.dev)\n", events, path);
+                }
+            }
+        }
+        else if (command.substr(0, 13) == "metrics_start") {
+            stringstream ss(command);
+            string cmd;
+            unsigned short port = MetricsExporter::DEFAULT_PORT;
+            string error;
+
+            ss >> cmd;
+            if (!(ss >> port)) port = MetricsExporter::DEFAULT_PORT;
+
+            if (exporter.start(port, error)) {
+                fmt::print(fg(fmt::color::green) | fmt::emphasis::bold,
+                           "> Serving metrics on http://127.0.0.1:{}/metrics\n", port);
+            } else {
+                fmt::print(fg(fmt::color::red) | fmt::emphasis::bold,
+                           "> Failed to start metrics listener: {}\n", error);
+            }
+        }
+        else if (command.substr(0, 12) == "metrics_stop") {
+            exporter.stop();
+            fmt::print(fg(fmt::color::yellow), "> Metrics listener stopped\n");
+        }
         else if (command.substr(0, 4) == "show") {
             // Show metadata for a specific connection
             int id = atoi(command.substr(5).c_str());
@@ -137,12 +431,16 @@ int main() {
             ss >> cmd >> id;
             getline(ss, message);
             
-            endpoint.send(id, message);
-
-            // Wait for message processing
-            unique_lock<mutex> lock(endpoint.get_metadata(id)->mtx);
-            endpoint.get_metadata(id)->cv.wait(lock, [&] { return endpoint.get_metadata(id)->MSG_PROCESSED; });
-            endpoint.get_metadata(id)->MSG_PROCESSED = false;
+            // Requests with an id wait for their own response; anything
+            // else is fire-and-forget
+            long long request_id;
+            string method;
+            if (utils::peek_rpc_header(message, request_id, method)) {
+                future<json> response = endpoint.send_request(id, message);
+                await_response(response);
+            } else {
+                endpoint.send(id, message);
+            }
         }
         else if (command == "Deribit connect") {
             // Special Deribit connection
@@ -194,16 +492,25 @@ int main() {
             int id; 
             string cmd;
         
+            // A trailing '&' sends without waiting, so several orders can be
+            // in flight at once; their responses print as they arrive
+            bool background = false;
+            size_t last = command.find_last_not_of(' ');
+            if (last != string::npos && command[last] == '&') {
+                background = true;
+                command.erase(command.find_last_not_of(' ', last - 1) + 1);
+            }
+
             stringstream ss(command);
             ss >> cmd >> id;
             
             string msg = api::process(command);
             if (msg != "") {
-                int success = endpoint.send(id, msg);
-                if (success >= 0) {
-                    unique_lock<mutex> lock(endpoint.get_metadata(id)->mtx);
-                    endpoint.get_metadata(id)->cv.wait(lock, [&] { return endpoint.get_metadata(id)->MSG_PROCESSED; });
-                    endpoint.get_metadata(id)->MSG_PROCESSED = false;
+                if (background) {
+                    endpoint.send(id, msg);
+                } else {
+                    future<json> response = endpoint.send_request(id, msg);
+                    await_response(response);
                 }
             }
         }
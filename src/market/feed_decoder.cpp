@@ -0,0 +1,401 @@
+#include "market/feed_decoder.h"
+
+#include <climits>
+
+#include "utils/json_scan.h"
+
+using namespace std;
+
+namespace {
+
+// FNV-1a, so member keys can be switched on; each case still compares the
+// key, as a key outside the schema could share a hash
+constexpr uint32_t key_hash(string_view key) {
+    uint32_t hash = 2166136261u;
+    for (char c : key) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+// Channel kinds by perfect hash of their first segment: bits 1-2 of its
+// second character tell the four apart
+struct channel_entry {
+    string_view prefix;
+    feed::channel_kind kind;
+};
+
+constexpr channel_entry channel_table[4] = {
+    {"ticker", feed::CHANNEL_TICKER},
+    {"trades", feed::CHANNEL_TRADES},
+    {"deribit_price_index", feed::CHANNEL_PRICE_INDEX},
+    {"book", feed::CHANNEL_BOOK}
+};
+
+constexpr size_t channel_slot(string_view prefix) {
+    return (static_cast<unsigned char>(prefix[1]) >> 1) & 3;
+}
+
+static_assert(channel_slot("ticker") == feed::CHANNEL_TICKER &&
+              channel_slot("trades") == feed::CHANNEL_TRADES &&
+              channel_slot("deribit_price_index") == feed::CHANNEL_PRICE_INDEX &&
+              channel_slot("book") == feed::CHANNEL_BOOK,
+              "channel_table no longer hashes perfectly");
+
+constexpr int64_t powers_of_ten[19] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+    10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000,
+    1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000
+};
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+void read_fixed(string_view value, int64_t &out) {
+    if (!feed::parse_fixed(value, out)) out = 0;
+}
+
+void read_int(string_view value, int64_t &out) {
+    if (!json_scan::as_int64(value, out)) out = 0;
+}
+
+// ["new", price, amount] in raw books, [price, amount] in grouped ones
+bool decode_level(string_view value, feed::book_level &level) {
+    json_scan::elements fields(value);
+    string_view first, second, third;
+    if (!fields.next(first) || !fields.next(second)) return false;
+
+    if (!fields.next(third)) {
+        level.action = feed::BOOK_LEVEL;
+        return feed::parse_fixed(first, level.price) && feed::parse_fixed(second, level.amount);
+    }
+
+    string_view action = json_scan::as_string(first);
+    if (action == "change") {
+        level.action = feed::BOOK_CHANGE;
+    } else if (action == "new") {
+        level.action = feed::BOOK_NEW;
+    } else if (action == "delete") {
+        level.action = feed::BOOK_DELETE;
+    } else {
+        return false;
+    }
+    return feed::parse_fixed(second, level.price) && feed::parse_fixed(third, level.amount);
+}
+
+bool decode_levels(string_view value, vector<feed::book_level> &levels) {
+    levels.clear();
+    json_scan::elements entries(value);
+    string_view entry;
+    feed::book_level level;
+    while (entries.next(entry)) {
+        if (!decode_level(entry, level)) return false;
+        levels.push_back(level);
+    }
+    return true;
+}
+
+bool decode_trade(string_view value, feed::trade &out, string_view &instrument_name) {
+    out = feed::trade{};
+    json_scan::members members(value);
+    string_view key, field;
+    bool any = false;
+
+    while (members.next(key, field)) {
+        any = true;
+        switch (key_hash(key)) {
+            case key_hash("timestamp"):
+                if (key == "timestamp") read_int(field, out.timestamp_ms);
+                break;
+            case key_hash("trade_seq"):
+                if (key == "trade_seq") read_int(field, out.trade_seq);
+                break;
+            case key_hash("price"):
+                if (key == "price") read_fixed(field, out.price);
+                break;
+            case key_hash("amount"):
+                if (key == "amount") read_fixed(field, out.amount);
+                break;
+            case key_hash("mark_price"):
+                if (key == "mark_price") read_fixed(field, out.mark_price);
+                break;
+            case key_hash("index_price"):
+                if (key == "index_price") read_fixed(field, out.index_price);
+                break;
+            case key_hash("tick_direction"): {
+                int64_t direction;
+                if (key == "tick_direction" && json_scan::as_int64(field, direction)) {
+                    out.tick_direction = static_cast<int8_t>(direction);
+                }
+                break;
+            }
+            case key_hash("direction"):
+                if (key == "direction") out.buy = json_scan::as_string(field) == "buy";
+                break;
+            case key_hash("instrument_name"):
+                if (key == "instrument_name") instrument_name = json_scan::as_string(field);
+                break;
+        }
+    }
+    return any;
+}
+
+} // namespace
+
+bool feed::parse_fixed(string_view text, int64_t &out) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    if (p == end) return false;
+
+    bool negative = *p == '-';
+    if (negative) ++p;
+
+    // Up to 18 significant digits; further ones only move the exponent
+    int64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool any_digit = false;
+
+    for (; p < end && is_digit(*p); ++p) {
+        any_digit = true;
+        if (significant < 18) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) ++significant;
+        } else {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && is_digit(*p); ++p) {
+            any_digit = true;
+            if (significant < 18) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) ++significant;
+                --exponent;
+            }
+        }
+    }
+    if (!any_digit) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negative_exponent = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negative_exponent = *p == '-';
+            ++p;
+        }
+        int value = 0;
+        bool any_exponent_digit = false;
+        for (; p < end && is_digit(*p); ++p) {
+            any_exponent_digit = true;
+            if (value < 1000) value = value * 10 + (*p - '0');
+        }
+        if (!any_exponent_digit) return false;
+        exponent += negative_exponent ? -value : value;
+    }
+    if (p != end) return false;
+
+    // mantissa * 10^exponent, scaled: shift the decimal point FIXED_DECIMALS right
+    int shift = exponent + FIXED_DECIMALS;
+    if (shift > 0) {
+        for (; shift > 0; --shift) {
+            if (mantissa > LLONG_MAX / 10) return false;
+            mantissa *= 10;
+        }
+    } else if (shift < -18) {
+        mantissa = 0;
+    } else if (shift < 0) {
+        int64_t divisor = powers_of_ten[-shift];
+        mantissa = mantissa / divisor + (mantissa % divisor >= (divisor + 1) / 2 ? 1 : 0);
+    }
+
+    out = negative ? -mantissa : mantissa;
+    return true;
+}
+
+feed::channel_kind feed::classify_channel(string_view channel) {
+    string_view prefix = channel.substr(0, channel.find('.'));
+    if (prefix.size() < 2) return CHANNEL_OTHER;
+
+    channel_entry const &entry = channel_table[channel_slot(prefix)];
+    return entry.prefix == prefix ? entry.kind : CHANNEL_OTHER;
+}
+
+const char* feed::channel_kind_name(channel_kind kind) {
+    switch (kind) {
+        case CHANNEL_TICKER: return "ticker";
+        case CHANNEL_TRADES: return "trades";
+        case CHANNEL_PRICE_INDEX: return "deribit_price_index";
+        case CHANNEL_BOOK: return "book";
+        default: return "other";
+    }
+}
+
+bool feed::decode(string_view data, book_update &out) {
+    out.instrument_name = string_view();
+    out.timestamp_ms = 0;
+    out.change_id = 0;
+    out.prev_change_id = 0;
+    out.snapshot = false;
+    out.bids.clear();
+    out.asks.clear();
+
+    json_scan::members members(data);
+    string_view key, value;
+    bool any = false;
+
+    while (members.next(key, value)) {
+        any = true;
+        switch (key_hash(key)) {
+            case key_hash("type"):
+                if (key == "type") out.snapshot = json_scan::as_string(value) == "snapshot";
+                break;
+            case key_hash("timestamp"):
+                if (key == "timestamp") read_int(value, out.timestamp_ms);
+                break;
+            case key_hash("instrument_name"):
+                if (key == "instrument_name") out.instrument_name = json_scan::as_string(value);
+                break;
+            case key_hash("change_id"):
+                if (key == "change_id") read_int(value, out.change_id);
+                break;
+            case key_hash("prev_change_id"):
+                if (key == "prev_change_id") read_int(value, out.prev_change_id);
+                break;
+            case key_hash("bids"):
+                if (key == "bids" && !decode_levels(value, out.bids)) return false;
+                break;
+            case key_hash("asks"):
+                if (key == "asks" && !decode_levels(value, out.asks)) return false;
+                break;
+        }
+    }
+    return any;
+}
+
+bool feed::decode(string_view data, ticker_update &out) {
+    out = ticker_update{};
+
+    json_scan::members members(data);
+    string_view key, value;
+    bool any = false;
+
+    while (members.next(key, value)) {
+        any = true;
+        switch (key_hash(key)) {
+            case key_hash("timestamp"):
+                if (key == "timestamp") read_int(value, out.timestamp_ms);
+                break;
+            case key_hash("instrument_name"):
+                if (key == "instrument_name") out.instrument_name = json_scan::as_string(value);
+                break;
+            case key_hash("best_bid_price"):
+                if (key == "best_bid_price") read_fixed(value, out.best_bid_price);
+                break;
+            case key_hash("best_bid_amount"):
+                if (key == "best_bid_amount") read_fixed(value, out.best_bid_amount);
+                break;
+            case key_hash("best_ask_price"):
+                if (key == "best_ask_price") read_fixed(value, out.best_ask_price);
+                break;
+            case key_hash("best_ask_amount"):
+                if (key == "best_ask_amount") read_fixed(value, out.best_ask_amount);
+                break;
+            case key_hash("last_price"):
+                if (key == "last_price") read_fixed(value, out.last_price);
+                break;
+            case key_hash("mark_price"):
+                if (key == "mark_price") read_fixed(value, out.mark_price);
+                break;
+            case key_hash("index_price"):
+                if (key == "index_price") read_fixed(value, out.index_price);
+                break;
+            case key_hash("open_interest"):
+                if (key == "open_interest") read_fixed(value, out.open_interest);
+                break;
+            case key_hash("min_price"):
+                if (key == "min_price") read_fixed(value, out.min_price);
+                break;
+            case key_hash("max_price"):
+                if (key == "max_price") read_fixed(value, out.max_price);
+                break;
+            case key_hash("current_funding"):
+                if (key == "current_funding") read_fixed(value, out.current_funding);
+                break;
+            case key_hash("funding_8h"):
+                if (key == "funding_8h") read_fixed(value, out.funding_8h);
+                break;
+            case key_hash("state"):
+                if (key == "state") out.state = json_scan::as_string(value);
+                break;
+        }
+    }
+    return any;
+}
+
+bool feed::decode(string_view data, trades_update &out) {
+    out.instrument_name = string_view();
+    out.trades.clear();
+
+    json_scan::elements entries(data);
+    string_view entry;
+    trade decoded;
+    string_view instrument_name;
+
+    while (entries.next(entry)) {
+        if (!decode_trade(entry, decoded, instrument_name)) return false;
+        if (out.trades.empty()) out.instrument_name = instrument_name;
+        out.trades.push_back(decoded);
+    }
+    return !out.trades.empty();
+}
+
+bool feed::decode(string_view data, price_index_update &out) {
+    out = price_index_update{};
+
+    json_scan::members members(data);
+    string_view key, value;
+    bool any = false;
+
+    while (members.next(key, value)) {
+        any = true;
+        switch (key_hash(key)) {
+            case key_hash("index_name"):
+                if (key == "index_name") out.index_name = json_scan::as_string(value);
+                break;
+            case key_hash("timestamp"):
+                if (key == "timestamp") read_int(value, out.timestamp_ms);
+                break;
+            case key_hash("price"):
+                if (key == "price") read_fixed(value, out.price);
+                break;
+        }
+    }
+    return any;
+}
+
+feed::channel_kind feed::decoder::decode(string_view channel, string_view data) {
+    m_timestamp_ms = -1;
+
+    switch (classify_channel(channel)) {
+        case CHANNEL_BOOK:
+            if (!feed::decode(data, m_book)) return CHANNEL_OTHER;
+            m_timestamp_ms = m_book.timestamp_ms;
+            return CHANNEL_BOOK;
+        case CHANNEL_TICKER:
+            if (!feed::decode(data, m_ticker)) return CHANNEL_OTHER;
+            m_timestamp_ms = m_ticker.timestamp_ms;
+            return CHANNEL_TICKER;
+        case CHANNEL_TRADES:
+            if (!feed::decode(data, m_trades)) return CHANNEL_OTHER;
+            m_timestamp_ms = m_trades.trades.back().timestamp_ms;
+            return CHANNEL_TRADES;
+        case CHANNEL_PRICE_INDEX:
+            if (!feed::decode(data, m_price_index)) return CHANNEL_OTHER;
+            m_timestamp_ms = m_price_index.timestamp_ms;
+            return CHANNEL_PRICE_INDEX;
+        default:
+            return CHANNEL_OTHER;
+    }
+}
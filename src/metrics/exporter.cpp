@@ -0,0 +1,97 @@
+#include "metrics/exporter.h"
+
+#include <sstream>
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+MetricsExporter::MetricsExporter() :
+    m_acceptor(m_io),
+    m_port(0)
+{}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+void MetricsExporter::add_collector(collector c) {
+    m_collectors.push_back(c);
+}
+
+bool MetricsExporter::start(unsigned short port, string& error) {
+    if (is_running()) {
+        error = "already running on port " + to_string(m_port);
+        return false;
+    }
+
+    boost::system::error_code ec;
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+
+    m_acceptor.open(endpoint.protocol(), ec);
+    if (!ec) m_acceptor.set_option(tcp::acceptor::reuse_address(true), ec);
+    if (!ec) m_acceptor.bind(endpoint, ec);
+    if (!ec) m_acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+    if (ec) {
+        error = ec.message();
+        m_acceptor.close(ec);
+        return false;
+    }
+
+    m_port = port;
+    m_io.restart();
+    accept_next();
+    m_thread = thread([this]() { m_io.run(); });
+    return true;
+}
+
+void MetricsExporter::stop() {
+    if (!is_running()) return;
+
+    m_io.stop();
+    m_thread.join();
+
+    boost::system::error_code ec;
+    m_acceptor.close(ec);
+}
+
+string MetricsExporter::render() {
+    ostringstream body;
+    for (auto& c : m_collectors) {
+        c(body);
+    }
+    return body.str();
+}
+
+void MetricsExporter::accept_next() {
+    auto socket = make_shared<tcp::socket>(m_io);
+    m_acceptor.async_accept(*socket, [this, socket](const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted) return;
+        if (!ec) serve(socket);
+        accept_next();
+    });
+}
+
+void MetricsExporter::serve(shared_ptr<tcp::socket> socket) {
+    auto request = make_shared<boost::asio::streambuf>();
+
+    // The request itself is irrelevant; wait for the end of its headers so
+    // the client isn't reset mid-send, then answer and close.
+    boost::asio::async_read_until(*socket, *request, "\r\n\r\n",
+        [this, socket, request](const boost::system::error_code& ec, size_t) {
+            if (ec) return;
+
+            string body = render();
+            auto response = make_shared<string>(
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                "Content-Length: " + to_string(body.size()) + "\r\n"
+                "Connection: close\r\n\r\n" + body
+            );
+
+            boost::asio::async_write(*socket, boost::asio::buffer(*response),
+                [socket, response](const boost::system::error_code&, size_t) {
+                    boost::system::error_code ignored;
+                    socket->shutdown(tcp::socket::shutdown_both, ignored);
+                });
+        });
+}
@@ -0,0 +1,363 @@
+#include "utils/json_scan.h"
+
+#include <charconv>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_SCAN_X86 1
+#endif
+
+using namespace std;
+
+namespace {
+
+// Finds the next character the scanner cares about at or after p, or end:
+// a quote or bracket while skipping a nested value (commas and colons,
+// the most frequent, don't matter there), a quote or backslash in a string
+typedef const char* (*find_fn)(const char* p, const char* end);
+
+bool is_bracket_or_quote(char c) {
+    switch (c) {
+        case '"': case '{': case '}': case '[': case ']':
+            return true;
+        default:
+            return false;
+    }
+}
+
+const char* find_bracket_scalar(const char* p, const char* end) {
+    while (p < end && !is_bracket_or_quote(*p)) ++p;
+    return p;
+}
+
+const char* find_quote_scalar(const char* p, const char* end) {
+    while (p < end && *p != '"' && *p != '\\') ++p;
+    return p;
+}
+
+#ifdef JSON_SCAN_X86
+
+__attribute__((target("sse4.2")))
+const char* find_bracket_sse42(const char* p, const char* end) {
+    const __m128i set = _mm_setr_epi8('"', '{', '}', '[', ']', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int index = _mm_cmpestri(set, 5, chunk, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16) return p + index;
+        p += 16;
+    }
+    return find_bracket_scalar(p, end);
+}
+
+__attribute__((target("sse4.2")))
+const char* find_quote_sse42(const char* p, const char* end) {
+    const __m128i set = _mm_setr_epi8('"', '\\', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int index = _mm_cmpestri(set, 2, chunk, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16) return p + index;
+        p += 16;
+    }
+    return find_quote_scalar(p, end);
+}
+
+// '{' and '[' (and '}' and ']') differ only in bit 0x20, so OR-ing it in
+// folds each pair into one comparison
+__attribute__((target("avx2")))
+const char* find_bracket_avx2(const char* p, const char* end) {
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i quote = _mm256_set1_epi8('"');
+
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i folded = _mm256_or_si256(chunk, case_bit);
+        __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+            _mm256_cmpeq_epi8(chunk, quote));
+        uint32_t mask = _mm256_movemask_epi8(hits);
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return find_bracket_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* find_quote_avx2(const char* p, const char* end) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t mask = _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return find_quote_scalar(p, end);
+}
+
+#endif // JSON_SCAN_X86
+
+json_scan::isa detect_isa() {
+#ifdef JSON_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return json_scan::ISA_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return json_scan::ISA_SSE42;
+#endif
+    return json_scan::ISA_SCALAR;
+}
+
+const json_scan::isa supported = detect_isa();
+json_scan::isa active = json_scan::ISA_SCALAR;
+find_fn find_bracket = find_bracket_scalar;
+find_fn find_quote = find_quote_scalar;
+
+void use_isa(json_scan::isa level) {
+    if (level > supported) level = supported;
+    active = level;
+    find_bracket = find_bracket_scalar;
+    find_quote = find_quote_scalar;
+#ifdef JSON_SCAN_X86
+    if (level == json_scan::ISA_AVX2) {
+        find_bracket = find_bracket_avx2;
+        find_quote = find_quote_avx2;
+    } else if (level == json_scan::ISA_SSE42) {
+        find_bracket = find_bracket_sse42;
+        find_quote = find_quote_sse42;
+    }
+#endif
+}
+
+const bool initialized = (use_isa(supported), true);
+
+bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+const char* skip_space(const char* p, const char* end) {
+    while (p < end && is_space(*p)) ++p;
+    return p;
+}
+
+// p is at an opening quote; returns past the closing one, or nullptr
+const char* skip_string(const char* p, const char* end) {
+    ++p;
+    while (true) {
+        p = find_quote(p, end);
+        if (p == end) return nullptr;
+        if (*p == '"') return p + 1;
+        // Backslash: whatever follows is escaped
+        p += 2;
+        if (p > end) return nullptr;
+    }
+}
+
+// p is at the first character of a value; returns past its last, or nullptr
+const char* skip_value(const char* p, const char* end) {
+    if (p == end) return nullptr;
+    if (*p == '"') return skip_string(p, end);
+
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (true) {
+            p = find_bracket(p, end);
+            if (p == end) return nullptr;
+            if (*p == '"') {
+                p = skip_string(p, end);
+                if (!p) return nullptr;
+                continue;
+            }
+            if (*p == '{' || *p == '[') {
+                ++depth;
+            } else if (--depth == 0) {
+                return p + 1;
+            }
+            ++p;
+        }
+    }
+
+    // Number, true, false or null: short, so not worth vectorizing
+    const char* start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && !is_space(*p)) ++p;
+    return p == start ? nullptr : p;
+}
+
+// Calls visit(key, value_begin) for each member of the object starting at
+// p; visit returns past the value, or nullptr to give up. Returns past the
+// closing brace, or nullptr if the object is malformed or visit gave up.
+template <typename Visit>
+const char* for_each_member(const char* p, const char* end, Visit visit) {
+    p = skip_space(p + 1, end);
+    if (p < end && *p == '}') return p + 1;
+
+    while (p < end && *p == '"') {
+        const char* key_end = skip_string(p, end);
+        if (!key_end) return nullptr;
+        string_view key(p + 1, key_end - p - 2);
+
+        p = skip_space(key_end, end);
+        if (p == end || *p != ':') return nullptr;
+        p = skip_space(p + 1, end);
+
+        p = visit(key, p);
+        if (!p) return nullptr;
+
+        p = skip_space(p, end);
+        if (p == end) return nullptr;
+        if (*p == '}') return p + 1;
+        if (*p != ',') return nullptr;
+        p = skip_space(p + 1, end);
+    }
+    return nullptr;
+}
+
+} // namespace
+
+bool json_scan::scan_rpc(string_view text, rpc_fields &fields) {
+    fields = rpc_fields();
+
+    const char* end = text.data() + text.size();
+    const char* p = skip_space(text.data(), end);
+    if (p == end || *p != '{') return false;
+
+    // One pass: params is walked member by member rather than skipped and
+    // then searched
+    auto visit_params = [&](string_view key, const char* value) -> const char* {
+        const char* value_end = skip_value(value, end);
+        if (!value_end) return nullptr;
+        if (key == "channel") {
+            fields.channel = as_string(string_view(value, value_end - value));
+        } else if (key == "data") {
+            fields.data = string_view(value, value_end - value);
+        }
+        return value_end;
+    };
+
+    auto visit = [&](string_view key, const char* value) -> const char* {
+        const char* value_end = (key == "params" && value < end && *value == '{') ? for_each_member(value, end, visit_params)
+                                                                   : skip_value(value, end);
+        if (!value_end) return nullptr;
+        string_view raw(value, value_end - value);
+
+        if (key == "method") {
+            fields.method = as_string(raw);
+        } else if (key == "id") {
+            int64_t id = 0;
+            fields.has_id = as_int64(raw, id);
+            fields.id = id;
+        } else if (key == "params") {
+            fields.params = raw;
+        } else if (key == "result") {
+            fields.result = raw;
+        } else if (key == "error") {
+            fields.error = raw;
+        }
+        return value_end;
+    };
+
+    return for_each_member(p, end, visit) != nullptr;
+}
+
+string_view json_scan::find_member(string_view object, string_view key) {
+    members m(object);
+    string_view name, value;
+    while (m.next(name, value)) {
+        if (name == key) return value;
+    }
+    return string_view();
+}
+
+string_view json_scan::last_element(string_view array) {
+    elements e(array);
+    string_view value, last;
+    while (e.next(value)) last = value;
+    return last;
+}
+
+// m_p is at the next member or element, or null once done
+json_scan::members::members(string_view object) : m_p(nullptr), m_end(object.data() + object.size()) {
+    const char* p = skip_space(object.data(), m_end);
+    if (p == m_end || *p != '{') return;
+    p = skip_space(p + 1, m_end);
+    if (p < m_end && *p != '}') m_p = p;
+}
+
+bool json_scan::members::next(string_view &key, string_view &value) {
+    const char* p = m_p;
+    m_p = nullptr;
+    if (!p || *p != '"') return false;
+
+    const char* key_end = skip_string(p, m_end);
+    if (!key_end) return false;
+    key = string_view(p + 1, key_end - p - 2);
+
+    p = skip_space(key_end, m_end);
+    if (p == m_end || *p != ':') return false;
+    p = skip_space(p + 1, m_end);
+
+    const char* value_end = skip_value(p, m_end);
+    if (!value_end) return false;
+    value = string_view(p, value_end - p);
+
+    p = skip_space(value_end, m_end);
+    if (p == m_end) return false;
+    if (*p == ',') m_p = skip_space(p + 1, m_end);
+    return *p == ',' || *p == '}';
+}
+
+json_scan::elements::elements(string_view array) : m_p(nullptr), m_end(array.data() + array.size()) {
+    const char* p = skip_space(array.data(), m_end);
+    if (p == m_end || *p != '[') return;
+    p = skip_space(p + 1, m_end);
+    if (p < m_end && *p != ']') m_p = p;
+}
+
+bool json_scan::elements::next(string_view &value) {
+    const char* p = m_p;
+    m_p = nullptr;
+    if (!p) return false;
+
+    const char* value_end = skip_value(p, m_end);
+    if (!value_end) return false;
+    value = string_view(p, value_end - p);
+
+    p = skip_space(value_end, m_end);
+    if (p == m_end) return false;
+    if (*p == ',') m_p = skip_space(p + 1, m_end);
+    return *p == ',' || *p == ']';
+}
+
+string_view json_scan::as_string(string_view value) {
+    if (value.size() < 2 || value.front() != '"' || value.back() != '"') return string_view();
+    return value.substr(1, value.size() - 2);
+}
+
+bool json_scan::as_int64(string_view value, int64_t &out) {
+    if (value.empty()) return false;
+    auto result = from_chars(value.data(), value.data() + value.size(), out);
+    return result.ec == errc() && result.ptr == value.data() + value.size();
+}
+
+json_scan::isa json_scan::supported_isa() {
+    return supported;
+}
+
+json_scan::isa json_scan::active_isa() {
+    return active;
+}
+
+void json_scan::set_isa(isa level) {
+    use_isa(level);
+}
+
+const char* json_scan::isa_name(isa level) {
+    switch (level) {
+        case ISA_AVX2: return "AVX2";
+        case ISA_SSE42: return "SSE4.2";
+        default: return "scalar";
+    }
+}
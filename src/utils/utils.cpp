@@ -14,6 +14,7 @@
 #else
 #include <termios.h>
 #include <unistd.h>
+#include <poll.h>
 #endif
 #include <fcntl.h>
 
@@ -52,16 +53,30 @@ void utils::printHelp() {
     cout << "GENERAL COMMANDS:\n"
               << fmt::format("  {:<30} : {}\n", "> help", "Displays this help text")
               << fmt::format("  {:<30} : {}\n", "> quit / exit", "Exits the program")
-              << fmt::format("  {:<30} : {}\n", "> connect <URI>", "Creates a WebSocket connection with the given URI")
+              << fmt::format("  {:<30} : {}\n", "> connect <URI> [market|trading]",
+                              "Creates a WebSocket connection with the given wss:// or ws:// URI on the market-data or trading (default) "
+                              "I/O thread; add deflate to offer permessage-deflate on a wss:// market-data connection")
+              << fmt::format("  {:<30} : {}\n", "> io_thread [market|trading] ...",
+                              "Shows I/O threads, or sets cpu <n>|none, fifo <priority>|off, busy_poll <idle_us>|off (0 = never block)")
               << fmt::format("  {:<30} : {}\n", "> close <id> [code] [reason]",
                               "Closes the WebSocket connection with the specified ID; optionally specify exit code and reason")
               << fmt::format("  {:<30} : {}\n", "> show <id>", "Displays metadata for the specified connection")
-              << fmt::format("  {:<30} : {}\n", "> show_messages <id>", "Lists all messages sent and received on the specified connection")
+              << fmt::format("  {:<30} : {}\n", "> show_messages <id> [page]", "Pages through retained messages on the specified connection (newest page by default)")
+              << fmt::format("  {:<30} : {}\n", "> history_spill <id> <file>|off", "Compresses messages evicted from the history to a gzip log")
+              << fmt::format("  {:<30} : {}\n", "> pool [<URI> <n>|off] [role]", "Keeps n logged-in spare connections open so connect returns at once")
+              << fmt::format("  {:<30} : {}\n", "> auto_reconnect <id> on|off", "Re-establishes a dropped connection, its login and subscriptions (on by default)")
               << fmt::format("  {:<30} : {}\n", "> send <id> <message>", "Sends a message to the specified connection")
               << fmt::format("  {:<30} : {}\n", "> view_subscriptions", "Displays the list of subscribed symbols to stream continuous orderbook updates")
               << fmt::format("  {:<30} : {}\n", "> view_stream", "Displays the stream continuous orderbook updates subscribed symbols")
               << fmt::format("  {:<30} : {}\n", "> latency_report", "Generates a performance latency report for the current session")
+              << fmt::format("  {:<30} : {}\n", "> latency_watch [interval_ms]", "Live view of the last 10s / 1m / 5m latency windows; press q to stop")
+              << fmt::format("  {:<30} : {}\n", "> latency_interval [ms|off]", "Expected request interval for coordinated-omission corrected round-trips")
               << fmt::format("  {:<30} : {}\n", "> reset_report", "Clears the latency report data for the current session")
+              << fmt::format("  {:<30} : {}\n", "> latency_clock [tsc|steady]", "Shows or switches the clock used for latency measurements")
+              << fmt::format("  {:<30} : {}\n", "> trace_start / trace_stop", "Starts or stops recording message handling spans")
+              << fmt::format("  {:<30} : {}\n", "> trace_dump <file>", "Writes recorded spans as Chrome trace JSON (loads in Perfetto)")
+              << fmt::format("  {:<30} : {}\n", "> metrics_start [port]", "Serves Prometheus metrics on 127.0.0.1 (default port 9464)")
+              << fmt::format("  {:<30} : {}\n", "> metrics_stop", "Stops the Prometheus metrics listener")
               << "\n";
 
     cout << "DERIBIT API COMMANDS:\n\n"
@@ -168,9 +183,115 @@ string utils::get_signature(long long timestamp, string nonce, string data, stri
     return utils::hmac_sha256(clientsecret, string_to_code);
 }
 
-string utils::pretty(string j) {
-    json serialised = json::parse(j);
-    return serialised.dump(4);
+// Lays the text out the way dump(4) does, without building a DOM: keys keep
+// the order they were sent in, and strings and numbers are copied verbatim.
+// Only whitespace is changed, so malformed input comes back malformed.
+string utils::pretty(string_view text) {
+    string out;
+    out.reserve(text.size() * 2);
+
+    int depth = 0;
+    auto newline = [&out](int level) {
+        out += '\n';
+        out.append(size_t(level) * 4, ' ');
+    };
+
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i++];
+        switch (c) {
+        case '"': {
+            size_t start = i - 1;
+            while (i < text.size() && text[i] != '"') i += (text[i] == '\\') ? 2 : 1;
+            i = min(i + 1, text.size());
+            out.append(text.data() + start, i - start);
+            break;
+        }
+        case '{':
+        case '[': {
+            // Empty containers stay on one line
+            char close = (c == '{') ? '}' : ']';
+            size_t next = text.find_first_not_of(" \t\r\n", i);
+            out += c;
+            if (next != string_view::npos && text[next] == close) {
+                out += close;
+                i = next + 1;
+            } else {
+                newline(++depth);
+            }
+            break;
+        }
+        case '}':
+        case ']':
+            depth = max(depth - 1, 0);
+            newline(depth);
+            out += c;
+            break;
+        case ',':
+            out += ',';
+            newline(depth);
+            break;
+        case ':':
+            out += ": ";
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+        default:
+            out += c;
+        }
+    }
+    return out;
+}
+
+string utils::openmetrics_label(string_view value) {
+    string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\n') {
+            escaped += "\\n";
+            continue;
+        }
+        if (c == '\\' || c == '"') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Returns the offset just past `"key":`, or string::npos
+static size_t find_json_key(const string& message, const string& key) {
+    string quoted = "\"" + key + "\"";
+    size_t pos = message.find(quoted);
+    while (pos != string::npos) {
+        size_t colon = message.find_first_not_of(" \t\r\n", pos + quoted.size());
+        if (colon != string::npos && message[colon] == ':') return colon + 1;
+        pos = message.find(quoted, pos + 1);
+    }
+    return string::npos;
+}
+
+bool utils::peek_rpc_header(const string& message, long long& id, string& method) {
+    size_t pos = find_json_key(message, "id");
+    if (pos == string::npos) return false;
+
+    const char* begin = message.c_str() + pos;
+    while (*begin == ' ') ++begin;
+    char* end;
+    id = strtoll(begin, &end, 10);
+    if (end == begin) return false;
+
+    method.clear();
+    pos = find_json_key(message, "method");
+    if (pos != string::npos) {
+        size_t open_quote = message.find('"', pos);
+        size_t close_quote = open_quote == string::npos ? string::npos : message.find('"', open_quote + 1);
+        if (close_quote != string::npos) {
+            method = message.substr(open_quote + 1, close_quote - open_quote - 1);
+        }
+    }
+    return true;
 }
 
 string utils::printmap(map<string, string> mpp) {
@@ -227,6 +348,38 @@ void utils::clear_console() {
 #endif
 }
 
+void utils::watch_console(const function<string()>& render, int interval_ms) {
+    struct termios oldt, newt;
+    tcgetattr(STDIN_FILENO, &oldt);
+    newt = oldt;
+
+    newt.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+
+    bool watching = true;
+    while (watching) {
+        string frame = render();
+        cout << "\033[H\033[J" << frame;
+        fmt::print(fmt::fg(fmt::color::blue) | fmt::emphasis::bold, "\n> Press 'q' to stop watching\n");
+        cout << flush;
+
+        // Sleep until the next refresh, waking early on a key press
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(interval_ms);
+        while (watching) {
+            int remaining = chrono::duration_cast<chrono::milliseconds>(
+                deadline - chrono::steady_clock::now()).count();
+            if (remaining <= 0) break;
+
+            struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+            if (poll(&pfd, 1, remaining) <= 0) break;
+
+            char ch;
+            if (read(STDIN_FILENO, &ch, 1) <= 0 || ch == 'q' || ch == 'Q') watching = false;
+        }
+    }
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+}
 
 bool utils::is_key_pressed(char key) {
     struct termios oldt, newt;
@@ -0,0 +1,108 @@
+#include "websocket/message_history.h"
+
+#include <zlib.h>
+
+using namespace std;
+
+message_history::message_history(size_t capacity, size_t byte_budget) :
+    m_ring(capacity > 0 ? capacity : 1),
+    m_first(0),
+    m_count(0),
+    m_bytes(0),
+    m_byte_budget(byte_budget),
+    m_next_seq(1),
+    m_evicted(0),
+    m_spill(nullptr)
+{}
+
+message_history::~message_history() {
+    if (m_spill) gzclose(static_cast<gzFile>(m_spill));
+}
+
+void message_history::evict_oldest() {
+    entry &oldest = m_ring[m_first];
+
+    if (m_spill) {
+        gzFile spill = static_cast<gzFile>(m_spill);
+        gzprintf(spill, "%llu\t", static_cast<unsigned long long>(oldest.seq));
+        gzwrite(spill, oldest.text.data(), oldest.text.size());
+        gzputc(spill, '\n');
+    }
+
+    m_bytes -= oldest.text.size();
+    // Release the memory now rather than when the slot is reused
+    string().swap(oldest.text);
+    m_first = (m_first + 1) % m_ring.size();
+    --m_count;
+    ++m_evicted;
+}
+
+void message_history::append(string text) {
+    lock_guard<mutex> lock(m_mutex);
+
+    while (m_count > 0 && (m_count == m_ring.size() || m_bytes + text.size() > m_byte_budget)) {
+        evict_oldest();
+    }
+
+    size_t slot = (m_first + m_count) % m_ring.size();
+    m_bytes += text.size();
+    m_ring[slot].seq = m_next_seq++;
+    m_ring[slot].text = move(text);
+    ++m_count;
+}
+
+vector<message_history::entry> message_history::page(size_t first, size_t count) const {
+    lock_guard<mutex> lock(m_mutex);
+
+    vector<entry> entries;
+    for (size_t i = first; i < m_count && i < first + count; ++i) {
+        entries.push_back(m_ring[(m_first + i) % m_ring.size()]);
+    }
+    return entries;
+}
+
+size_t message_history::size() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_count;
+}
+
+size_t message_history::bytes() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+uint64_t message_history::total() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_next_seq - 1;
+}
+
+uint64_t message_history::evicted() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_evicted;
+}
+
+bool message_history::set_spill_file(string const &path, string &error) {
+    lock_guard<mutex> lock(m_mutex);
+
+    if (m_spill) {
+        gzclose(static_cast<gzFile>(m_spill));
+        m_spill = nullptr;
+        m_spill_path.clear();
+    }
+    if (path.empty()) return true;
+
+    // Append, so spilling can be stopped and resumed into the same log
+    gzFile spill = gzopen(path.c_str(), "ab");
+    if (!spill) {
+        error = "cannot open " + path;
+        return false;
+    }
+    m_spill = spill;
+    m_spill_path = path;
+    return true;
+}
+
+string message_history::spill_file() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_spill_path;
+}
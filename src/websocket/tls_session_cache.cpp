@@ -0,0 +1,82 @@
+#include "websocket/tls_session_cache.h"
+
+using namespace std;
+
+// Where the SSL_CTX keeps its cache, and each SSL the key of its session
+static int context_index() {
+    static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+static int key_index() {
+    static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+tls_session_cache::tls_session_cache(shared_ptr<boost::asio::ssl::context> context) :
+    m_context(context),
+    m_full(0),
+    m_resumed(0)
+{
+    SSL_CTX* ctx = m_context->native_handle();
+    SSL_CTX_set_ex_data(ctx, context_index(), this);
+
+    // Client caching only works through the callback; OpenSSL's internal
+    // store is for servers
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, &tls_session_cache::on_new_session);
+}
+
+tls_session_cache::~tls_session_cache() {
+    SSL_CTX_sess_set_new_cb(m_context->native_handle(), nullptr);
+    for (auto &entry : m_sessions) {
+        SSL_SESSION_free(entry.second);
+    }
+}
+
+void tls_session_cache::attach(SSL* ssl, string const &key) {
+    lock_guard<mutex> lock(m_mutex);
+
+    auto it = m_sessions.emplace(key, nullptr).first;
+    SSL_set_ex_data(ssl, key_index(), const_cast<string*>(&it->first));
+
+    if (it->second && SSL_SESSION_is_resumable(it->second)) {
+        SSL_set_session(ssl, it->second);
+    }
+}
+
+int tls_session_cache::on_new_session(SSL* ssl, SSL_SESSION* session) {
+    tls_session_cache* cache = static_cast<tls_session_cache*>(
+        SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), context_index()));
+    string* key = static_cast<string*>(SSL_get_ex_data(ssl, key_index()));
+    if (!cache || !key) return 0;
+
+    // A copy: OpenSSL marks the connection's own session unresumable if
+    // the connection drops without a TLS shutdown, which is exactly when
+    // a quick reconnect matters
+    SSL_SESSION* copy = SSL_SESSION_dup(session);
+    if (!copy) return 0;
+
+    lock_guard<mutex> lock(cache->m_mutex);
+    SSL_SESSION* &cached = cache->m_sessions[*key];
+    if (cached) SSL_SESSION_free(cached);
+    cached = copy;
+    return 0;
+}
+
+void tls_session_cache::record_handshake(SSL* ssl) {
+    if (SSL_session_reused(ssl)) {
+        m_resumed.fetch_add(1, memory_order_relaxed);
+    } else {
+        m_full.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+size_t tls_session_cache::cached_sessions() const {
+    lock_guard<mutex> lock(m_mutex);
+    size_t count = 0;
+    for (auto const &entry : m_sessions) {
+        if (entry.second) ++count;
+    }
+    return count;
+}
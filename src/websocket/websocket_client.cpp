@@ -2,7 +2,15 @@
 #include "utils/utils.h"
 #include "authentication/password.h"
 #include <fmt/color.h>
-#include "latency/tracker.h"
+#include "latency/instrumentation.h"
+#include "latency/trace.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <random>
 
 using namespace std;
 
@@ -12,36 +20,458 @@ connection_metadata::connection_metadata(
     int id, 
     websocketpp::connection_hdl hdl, 
     string uri, 
-    websocket_endpoint* endpoint
+    websocket_endpoint* endpoint,
+    io_role role,
+    bool compress
 ) :
     m_id(id),
     m_hdl(hdl),
+    m_client(nullptr),
+    m_deflate_client(nullptr),
+    m_plain_client(nullptr),
+    m_compress(compress),
+    m_deflate_negotiated(false),
     m_status("Connecting"),
     m_uri(uri),
     m_server("N/A"),
-    m_messages({}),
-    m_summaries({}),
+    m_messages(HISTORY_CAPACITY, HISTORY_BYTE_BUDGET),
+    m_summaries(SUMMARY_CAPACITY, SUMMARY_BYTE_BUDGET),
     m_endpoint(endpoint),
-    MSG_PROCESSED(false)
+    m_role(role),
+    m_pending_ring(PENDING_RING_SIZE),
+    m_pending_count(0),
+    m_probe_id(0),
+    m_set_heartbeat_id(0),
+    m_heartbeat_test_id(0),
+    m_heartbeat_handle(0),
+    m_heartbeats_received(0),
+    m_heartbeat_rtt_us(-1),
+    m_inbox(INBOX_CAPACITY),
+    m_consumer_running(false),
+    m_consumer_sleeping(false),
+    m_auto_reconnect(true),
+    m_close_requested(false),
+    m_was_connected(false),
+    m_reconnect_attempts(0),
+    m_first_tick_handle(0),
+    m_open_orders(0),
+    m_connect_handle(0),
+    m_connect_us(-1),
+    m_tls_resumed(false),
+    m_spare(false),
+    m_authorized(false)
 {}
 
 int connection_metadata::get_id() { return m_id; }
-websocketpp::connection_hdl connection_metadata::get_hdl() { return m_hdl; }
 string connection_metadata::get_status() { return m_status; }
 
+websocketpp::connection_hdl connection_metadata::get_hdl() {
+    lock_guard<mutex> lock(m_hdl_mutex);
+    return m_hdl;
+}
+
+void connection_metadata::set_connection(client * c, websocketpp::connection_hdl hdl) {
+    {
+        lock_guard<mutex> lock(m_hdl_mutex);
+        m_client = c;
+        m_hdl = hdl;
+    }
+
+    // Set-up is timed from here to on_open
+    m_connect_started = chrono::steady_clock::now();
+    Instrumentation::cancel(m_connect_handle.exchange(
+        Instrumentation::start(LatencyTracker::CONNECTION_SETUP)));
+}
+
+void connection_metadata::set_connection(deflate_client * c, websocketpp::connection_hdl hdl) {
+    {
+        lock_guard<mutex> lock(m_hdl_mutex);
+        m_deflate_client = c;
+        m_hdl = hdl;
+    }
+
+    m_connect_started = chrono::steady_clock::now();
+    Instrumentation::cancel(m_connect_handle.exchange(
+        Instrumentation::start(LatencyTracker::CONNECTION_SETUP)));
+}
+
+void connection_metadata::set_connection(plain_client * c, websocketpp::connection_hdl hdl) {
+    {
+        lock_guard<mutex> lock(m_hdl_mutex);
+        m_plain_client = c;
+        m_hdl = hdl;
+    }
+
+    m_connect_started = chrono::steady_clock::now();
+    Instrumentation::cancel(m_connect_handle.exchange(
+        Instrumentation::start(LatencyTracker::CONNECTION_SETUP)));
+}
+
+// Calls operation with the client that owns the connection, under m_hdl_mutex
+template <typename Operation>
+auto connection_metadata::with_client(Operation operation) {
+    lock_guard<mutex> lock(m_hdl_mutex);
+    if (m_deflate_client) return operation(m_deflate_client);
+    if (m_plain_client) return operation(m_plain_client);
+    return operation(m_client);
+}
+
+void connection_metadata::send_frame(string const &message, websocketpp::lib::error_code &ec) {
+    with_client([&](auto *c) {
+        c->send(m_hdl, message, websocketpp::frame::opcode::text, ec);
+    });
+}
+
+client::timer_ptr connection_metadata::set_timer(long delay_ms, client::timer_handler handler) {
+    return with_client([&](auto *c) {
+        return c->set_timer(delay_ms, handler);
+    });
+}
+
+void connection_metadata::close(websocketpp::close::status::value code, string const &reason,
+                                websocketpp::lib::error_code &ec) {
+    with_client([&](auto *c) {
+        c->close(m_hdl, code, reason, ec);
+    });
+}
+
+string connection_metadata::get_access_token() {
+    lock_guard<mutex> lock(m_session_mutex);
+    return m_access_token;
+}
+
 void connection_metadata::record_sent_message(string const &message) {
-    m_messages.push_back("SENT: " + message);
+    m_stats.messages_out.fetch_add(1, memory_order_relaxed);
+    m_stats.bytes_out.fetch_add(message.size(), memory_order_relaxed);
+    m_messages.append("SENT: " + message);
 }
 
-void connection_metadata::record_summary(string const &message, string const &sent) {
-    if (message == "") return;
-    json parsed_msg = json::parse(message);
+int connection_metadata::send(string const &message, response_handler handler) {
+    TRACE_SPAN("connection_metadata::send");
+
+    // Register the request before the frame is handed to websocketpp so the
+    // response can't beat us to the table; this also starts the round-trip
+    // clock, which process_message stops when the response with the same id arrives
+    long long request_id;
+    string method;
+    bool is_request = utils::peek_rpc_header(message, request_id, method);
+    if (is_request) {
+        LatencyTracker::Handle latency_handle = 0;
+        if (DERIBIT_INSTRUMENTATION_LEVEL != DERIBIT_INSTRUMENTATION_OFF) {
+            int series = getLatencyTracker().register_series(
+                LatencyTracker::REQUEST_ROUND_TRIP, method.empty() ? "(no method)" : method
+            );
+            latency_handle = Instrumentation::start(series);
+        }
+
+        if (!track_request(request_id, latency_handle, method, move(handler))) {
+            Instrumentation::cancel(latency_handle);
+            cout << "> Request id " << request_id << " is already in flight on connection " << m_id << endl;
+            return -1;
+        }
+    } else if (handler) {
+        cout << "> Cannot wait for a response to a message without an integer \"id\"" << endl;
+        return -1;
+    }
+
+    websocketpp::lib::error_code ec;
+    send_frame(message, ec);
+
+    if (ec) {
+        if (is_request) untrack_request(request_id);
+        cout << "> Error sending message to connection " << m_id << ": "
+                  << ec.message() << endl;
+        return -1;
+    }
+
+    // Kept so a reconnect can log in again the same way
+    if (method == "public/auth") {
+        lock_guard<mutex> lock(m_session_mutex);
+        m_auth_request = message;
+    }
+
+    record_sent_message(message);
+    return 0;
+}
+
+// The ring slot for an id this connection allocated, whether or not it is
+// in use; nullptr for anyone else's id. Under m_pending_mutex.
+connection_metadata::pending_request* connection_metadata::pending_slot(long long request_id) {
+    if (request_id::class_of(request_id) == request_id::CLASS_FOREIGN ||
+        request_id::connection_of(request_id) != (m_id & (request_id::MAX_CONNECTIONS - 1))) {
+        return nullptr;
+    }
+    return &m_pending_ring[request_id::sequence_of(request_id) & (PENDING_RING_SIZE - 1)];
+}
+
+bool connection_metadata::track_request(long long request_id, LatencyTracker::Handle handle,
+                                        string const &method, response_handler handler) {
+    lock_guard<mutex> lock(m_pending_mutex);
+    pending_request* slot = pending_slot(request_id);
+    if (slot && slot->id == request_id) return false;
+
+    pending_request request{request_id, handle, method, move(handler)};
+    if (slot && slot->id == 0) {
+        *slot = move(request);
+    } else if (!m_pending_overflow.emplace(request_id, move(request)).second) {
+        return false;
+    }
+    ++m_pending_count;
+    return true;
+}
+
+// Moves the request with request_id out of the table; false if it isn't there
+bool connection_metadata::take_pending(long long request_id, pending_request &request) {
+    lock_guard<mutex> lock(m_pending_mutex);
+    if (m_pending_count == 0) return false;
+
+    pending_request* slot = pending_slot(request_id);
+    if (slot && slot->id == request_id) {
+        request = move(*slot);
+        *slot = pending_request();
+    } else {
+        auto it = m_pending_overflow.find(request_id);
+        if (it == m_pending_overflow.end()) return false;
+        request = move(it->second);
+        m_pending_overflow.erase(it);
+    }
+    --m_pending_count;
+    return true;
+}
+
+void connection_metadata::untrack_request(long long request_id) {
+    pending_request request;
+    if (take_pending(request_id, request)) Instrumentation::cancel(request.latency_handle);
+}
+
+void connection_metadata::cancel_pending_requests(string const &reason) {
+    vector<pending_request> cancelled;
+    {
+        lock_guard<mutex> lock(m_pending_mutex);
+        for (auto &slot : m_pending_ring) {
+            if (slot.id == 0) continue;
+            cancelled.push_back(move(slot));
+            slot = pending_request();
+        }
+        for (auto &entry : m_pending_overflow) cancelled.push_back(move(entry.second));
+        m_pending_overflow.clear();
+        m_pending_count = 0;
+    }
+
+    // Handlers run outside the lock so they may issue new requests
+    for (auto& request : cancelled) {
+        Instrumentation::cancel(request.latency_handle);
+        if (request.handler) {
+            request.handler(dom_json{
+                {"id", request.id},
+                {"error", {{"code", REQUEST_CANCELLED}, {"message", reason}}}
+            });
+        }
+    }
+}
+
+size_t connection_metadata::pending_request_count() {
+    lock_guard<mutex> lock(m_pending_mutex);
+    return m_pending_count;
+}
+
+void connection_metadata::schedule_clock_probe(long delay_ms) {
+    m_probe_timer = set_timer(delay_ms, websocketpp::lib::bind(
+                              &connection_metadata::on_clock_probe_timer,
+                              this,
+                              websocketpp::lib::placeholders::_1
+                              ));
+}
+
+void connection_metadata::cancel_clock_probe() {
+    if (m_probe_timer) m_probe_timer->cancel();
+}
+
+void connection_metadata::on_clock_probe_timer(websocketpp::lib::error_code const &ec) {
+    // Cancelled, or the connection has gone away since the timer was set
+    if (ec || m_status != "Connected") return;
+
+    m_probe_id = next_request_id(request_id::CLASS_CLOCK_PROBE);
+    json probe = {
+        {"jsonrpc", "2.0"},
+        {"id", m_probe_id},
+        {"method", "public/get_time"}
+    };
+
+    // Sent straight through websocketpp so probes stay out of the message
+    // history and round-trip stats
+    websocketpp::lib::error_code send_ec;
+    m_probe_sent = chrono::system_clock::now();
+    send_frame(probe.dump(), send_ec);
+
+    schedule_clock_probe(CLOCK_PROBE_INTERVAL_MS);
+}
+
+bool connection_metadata::send_control(string const &message) {
+    // Straight through websocketpp, like clock probes: no history, no
+    // round-trip series, no response routing
+    websocketpp::lib::error_code ec;
+    send_frame(message, ec);
+    return !ec;
+}
+
+void connection_metadata::enable_heartbeat() {
+    m_set_heartbeat_id = next_request_id(request_id::CLASS_HEARTBEAT);
+    json request = {
+        {"jsonrpc", "2.0"},
+        {"id", m_set_heartbeat_id},
+        {"method", "public/set_heartbeat"},
+        {"params", {{"interval", HEARTBEAT_INTERVAL_S}}}
+    };
+    send_control(request.dump());
+
+    m_last_received = chrono::steady_clock::now();
+    schedule_heartbeat_check();
+}
+
+void connection_metadata::send_heartbeat_test() {
+    // Only the newest test is timed
+    Instrumentation::cancel(m_heartbeat_handle);
+
+    m_heartbeat_test_id = next_request_id(request_id::CLASS_HEARTBEAT);
+    json request = {
+        {"jsonrpc", "2.0"},
+        {"id", m_heartbeat_test_id},
+        {"method", "public/test"},
+        {"params", json::object()}
+    };
+
+    m_heartbeat_handle = Instrumentation::start(LatencyTracker::HEARTBEAT_RTT);
+    m_heartbeat_sent = chrono::steady_clock::now();
+    if (!send_control(request.dump())) {
+        Instrumentation::cancel(m_heartbeat_handle);
+        m_heartbeat_handle = 0;
+    }
+}
+
+void connection_metadata::schedule_heartbeat_check() {
+    m_heartbeat_timer = set_timer(HEARTBEAT_INTERVAL_S * 1000, websocketpp::lib::bind(
+                                  &connection_metadata::on_heartbeat_check,
+                                  this,
+                                  websocketpp::lib::placeholders::_1
+                                  ));
+}
+
+void connection_metadata::cancel_heartbeat() {
+    if (m_heartbeat_timer) m_heartbeat_timer->cancel();
+    Instrumentation::cancel(m_heartbeat_handle);
+    m_heartbeat_handle = 0;
+}
+
+void connection_metadata::on_heartbeat_check(websocketpp::lib::error_code const &ec) {
+    if (ec || m_status != "Connected") return;
+
+    auto silent = chrono::steady_clock::now() - m_last_received;
+    if (silent > chrono::seconds(HEARTBEAT_INTERVAL_S * STALE_AFTER_INTERVALS)) {
+        // Close now rather than let the next order find out
+        m_status = "Stale";
+        fmt::print(fmt::fg(fmt::color::yellow) | fmt::emphasis::bold,
+                   "> Connection {} silent for {} s, closing it as stale\n", m_id,
+                   chrono::duration_cast<chrono::seconds>(silent).count());
+        websocketpp::lib::error_code close_ec;
+        close(websocketpp::close::status::going_away, "stale", close_ec);
+        return;
+    }
+
+    // A missed heartbeat: test the connection ourselves
+    if (silent > chrono::seconds(HEARTBEAT_INTERVAL_S)) send_heartbeat_test();
+
+    schedule_heartbeat_check();
+}
+
+bool connection_metadata::handle_heartbeat(json_scan::rpc_fields const &notification) {
+    if (notification.method != "heartbeat") return false;
+
+    m_heartbeats_received.fetch_add(1, memory_order_relaxed);
+
+    // Plain "heartbeat" notifications need no answer; an unanswered
+    // test_request gets the connection closed by the exchange
+    if (json_scan::as_string(json_scan::find_member(notification.params, "type")) == "test_request") {
+        send_heartbeat_test();
+    }
+    return true;
+}
+
+bool connection_metadata::handle_heartbeat_response(json_scan::rpc_fields const &response, uint64_t received_ticks) {
+    long long id = response.id;
+    if (id == m_heartbeat_test_id) {
+        Instrumentation::stop(m_heartbeat_handle, received_ticks);
+        m_heartbeat_handle = 0;
+        m_heartbeat_rtt_us.store(chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - m_heartbeat_sent).count(), memory_order_relaxed);
+        return true;
+    }
+
+    if (id == m_set_heartbeat_id) {
+        if (!response.error.empty()) {
+            fmt::print(fmt::fg(fmt::color::red) | fmt::emphasis::bold,
+                       "> public/set_heartbeat rejected on connection {}: {}\n", m_id, response.error);
+        }
+        return true;
+    }
+
+    // A reply to a test superseded by a newer one
+    return request_id::connection_of(id) == (m_id & (request_id::MAX_CONNECTIONS - 1));
+}
+
+bool connection_metadata::handle_clock_probe(json_scan::rpc_fields const &response,
+                                             chrono::system_clock::time_point received) {
+    if (m_probe_id == 0 || !response.has_id || response.id != m_probe_id) return false;
+
+    int64_t server_ms;
+    if (json_scan::as_int64(response.result, server_ms)) {
+        m_clock_offset.add_sample(
+            chrono::duration_cast<chrono::microseconds>(m_probe_sent.time_since_epoch()).count(),
+            server_ms,
+            chrono::duration_cast<chrono::microseconds>(received.time_since_epoch()).count()
+        );
+    }
+    return true;
+}
+
+// Exchange timestamp of a notification the feed decoders don't know;
+// for an array, of its newest entry. -1 if there is none.
+static int64_t feed_timestamp_ms(string_view data) {
+    if (data.empty()) return -1;
+    string_view stamped = data.front() == '[' ? json_scan::last_element(data) : data;
+    int64_t timestamp_ms;
+    return json_scan::as_int64(json_scan::find_member(stamped, "timestamp"), timestamp_ms) ? timestamp_ms : -1;
+}
+
+void connection_metadata::record_feed_latency(string_view channel, int64_t timestamp_ms,
+                                              chrono::system_clock::time_point received) {
+    if (!m_clock_offset.has_estimate() || channel.empty() || timestamp_ms < 0) return;
+
+    auto series = m_feed_series.find(channel);
+    if (series == m_feed_series.end()) {
+        string name(channel);
+        series = m_feed_series.emplace(
+            name, getLatencyTracker().register_series(LatencyTracker::FEED_LATENCY, name)
+        ).first;
+    }
+
+    // Exchange timestamp translated onto the local clock
+    int64_t sent_us = timestamp_ms * 1000 - m_clock_offset.offset_us();
+    int64_t received_us = chrono::duration_cast<chrono::microseconds>(received.time_since_epoch()).count();
+
+    Instrumentation::record(series->second, chrono::microseconds(received_us - sent_us));
+}
+
+// Summarizers take the message by reference: they index it with the
+// non-const operator[], and copying a large response per message was the
+// costliest part of summarizing it
+void connection_metadata::record_summary(dom_json &parsed_msg, string const &sent) {
     string cmd = parsed_msg.contains("method") ? parsed_msg["method"] : "received";
     map<string, string> summary;
     
-    map<string, function<map<string, string>(json)>> action_map = 
+    map<string, function<map<string, string>(dom_json &)>> action_map = 
     {
-        {"public/auth", [](json parsed_msg){ 
+        {"public/auth", [](dom_json &parsed_msg){ 
             map<string, string> summary;
             summary["method"] = parsed_msg["method"];
             summary["grant_type"] = parsed_msg["params"]["grant_type"];
@@ -52,7 +482,7 @@ void connection_metadata::record_summary(string const &message, string const &se
             return summary;
         }},
         
-        {"private/sell", [](json parsed_msg){
+        {"private/sell", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["instrument_name"] = parsed_msg["params"]["instrument_name"];
@@ -74,7 +504,7 @@ void connection_metadata::record_summary(string const &message, string const &se
             return summary;
         }},
         
-        {"private/buy", [](json parsed_msg){
+        {"private/buy", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["instrument_name"] = parsed_msg["params"]["instrument_name"];
@@ -96,7 +526,7 @@ void connection_metadata::record_summary(string const &message, string const &se
             return summary;
         }},
         
-        {"private/edit", [](json parsed_msg){
+        {"private/edit", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["order_id"] = parsed_msg["params"]["order_id"];
@@ -110,61 +540,61 @@ void connection_metadata::record_summary(string const &message, string const &se
             return summary;
         }},
         
-        {"private/cancel", [](json parsed_msg){
+        {"private/cancel", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["order_id"] = parsed_msg["params"]["order_id"];
             return summary;
         }},
         
-        {"private/cancel_all", [](json parsed_msg){
+        {"private/cancel_all", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             return summary;
         }},
         
-        {"private/cancel_all_by_instrument", [](json parsed_msg){
+        {"private/cancel_all_by_instrument", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["instrument"] = parsed_msg["params"]["instrument"];
             return summary;
         }},
         
-        {"private/cancel_by_label", [](json parsed_msg){
+        {"private/cancel_by_label", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["label"] = parsed_msg["params"]["label"];
             return summary;
         }},
         
-        {"private/cancel_all_by_currency", [](json parsed_msg){
+        {"private/cancel_all_by_currency", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["currency"] = parsed_msg["params"]["currency"];
             return summary;
         }},
         
-        {"private/get_open_orders", [](json parsed_msg){
+        {"private/get_open_orders", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             return summary;
         }},
         
-        {"private/get_open_orders_by_instrument", [](json parsed_msg){
+        {"private/get_open_orders_by_instrument", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["instrument"] = parsed_msg["params"]["instrument"];
             return summary;
         }},
         
-        {"private/get_open_orders_by_currency", [](json parsed_msg){
+        {"private/get_open_orders_by_currency", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["currency"] = parsed_msg["params"]["currency"];
             return summary;
         }},
         
-        {"private/get_open_orders_by_label", [](json parsed_msg){
+        {"private/get_open_orders_by_label", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["currency"] = parsed_msg["params"]["currency"];
@@ -172,7 +602,7 @@ void connection_metadata::record_summary(string const &message, string const &se
             return summary;
         }},
         
-        {"private/get_positions", [](json parsed_msg){
+        {"private/get_positions", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             
@@ -185,7 +615,7 @@ void connection_metadata::record_summary(string const &message, string const &se
             return summary;
         }},
         
-        {"public/get_order_book", [](json parsed_msg){
+        {"public/get_order_book", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             summary["method"] = parsed_msg["method"];
             summary["instrument_name"] = parsed_msg["params"]["instrument_name"];
@@ -193,143 +623,611 @@ void connection_metadata::record_summary(string const &message, string const &se
             return summary;
         }},
         
-        {"received", [](json parsed_msg){
+        {"received", [](dom_json &parsed_msg){
             map<string, string> summary = {};
             if (parsed_msg.contains("result"))
-                summary = {{"result", parsed_msg["result"].dump()}};
+                summary = {{"result", string(parsed_msg["result"].dump())}};
             else if (parsed_msg.contains("error"))
-                summary = {{"error message", parsed_msg["error"].dump()}};
+                summary = {{"error message", string(parsed_msg["error"].dump())}};
             return summary;
         }}
     };
     
     auto find = action_map.find(cmd);
     if (find == action_map.end()) {
-        summary["id"] = to_string(parsed_msg["id"].get<int>());
+        summary["id"] = to_string(parsed_msg["id"].get<long long>());
         if (sent == "SENT") summary["method"] = parsed_msg["method"];
     }
     else {
         summary = find->second(parsed_msg);
     }
-    m_summaries.push_back(sent + " : \n" + utils::printmap(summary));
+    m_summaries.append(sent + " : \n" + utils::printmap(summary));
+}
+
+void connection_metadata::record_summary(string const &message, string const &sent) {
+    if (message == "") return;
+    dom_json parsed_msg = dom_json::parse(message);
+    record_summary(parsed_msg, sent);
 }
 
-void connection_metadata::on_open(client * c, websocketpp::connection_hdl hdl) {
+// The OpenSSL handle behind a connection's socket; none for ws://
+static SSL* ssl_of(boost::asio::ssl::stream<boost::asio::ip::tcp::socket> &socket) {
+    return socket.native_handle();
+}
+
+static SSL* ssl_of(boost::asio::ip::tcp::socket &) {
+    return nullptr;
+}
+
+template <typename Client>
+void connection_metadata::on_open(Client * c, websocketpp::connection_hdl hdl) {
     m_status = "Connected";
-    client::connection_ptr con = c->get_con_from_hdl(hdl);
+    typename Client::connection_ptr con = c->get_con_from_hdl(hdl);
     m_server = con->get_response_header("Server");
+    m_deflate_negotiated.store(
+        con->get_response_header("Sec-WebSocket-Extensions").find("permessage-deflate") != string::npos);
+
+    Instrumentation::stop(m_connect_handle.exchange(0));
+    m_connect_us.store(chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now() - m_connect_started).count());
+    if (SSL* ssl = ssl_of(con->get_socket())) {
+        m_tls_resumed.store(SSL_session_reused(ssl));
+        if (m_endpoint) m_endpoint->tls_sessions().record_handshake(ssl);
+    }
+
+    // A reconnect that completed after the connection was closed on purpose
+    if (m_close_requested.load()) {
+        websocketpp::lib::error_code ec;
+        c->close(hdl, websocketpp::close::status::going_away, "", ec);
+        return;
+    }
+
+    // Start estimating the exchange clock offset for feed latency
+    schedule_clock_probe(0);
+    enable_heartbeat();
+
+    m_reconnect_attempts = 0;
+    if (m_spare.load() && !m_was_connected) {
+        // A fresh spare logs in with whatever credentials are in use
+        string auth = m_endpoint ? m_endpoint->auth_request() : "";
+        if (!auth.empty()) authorize(auth);
+    } else if (m_was_connected) {
+        fmt::print(fmt::fg(fmt::color::green) | fmt::emphasis::bold,
+                   "> Connection {} re-established\n", m_id);
+        restore_session();
+    }
+    m_was_connected = true;
 }
 
-void connection_metadata::on_fail(client * c, websocketpp::connection_hdl hdl) {
+template <typename Client>
+void connection_metadata::on_fail(Client * c, websocketpp::connection_hdl hdl) {
     m_status = "Failed";
-    client::connection_ptr con = c->get_con_from_hdl(hdl);
+    typename Client::connection_ptr con = c->get_con_from_hdl(hdl);
     m_server = con->get_response_header("Server");
     m_error_reason = con->get_ec().message();
+    Instrumentation::cancel(m_connect_handle.exchange(0));
+
+    cancel_pending_requests("connection failed: " + m_error_reason);
+    schedule_reconnect();
 }
 
-void connection_metadata::on_close(client * c, websocketpp::connection_hdl hdl) {
+template <typename Client>
+void connection_metadata::on_close(Client * c, websocketpp::connection_hdl hdl) {
     m_status = "Closed";
-    client::connection_ptr con = c->get_con_from_hdl(hdl);
+    typename Client::connection_ptr con = c->get_con_from_hdl(hdl);
     stringstream s;
     s << "Close code: " << con->get_remote_close_code() << "("
       << websocketpp::close::status::get_string(con->get_remote_close_code())
       << "), Close reason: " << con->get_remote_close_reason();
     
     m_error_reason = s.str();
+
+    cancel_pending_requests("connection closed");
+
+    cancel_clock_probe();
+    cancel_heartbeat();
+    schedule_reconnect();
+}
+
+void connection_metadata::schedule_reconnect() {
+    // Never retry a connection that didn't open in the first place: that is
+    // a bad URI or an unreachable host, not a dropped session
+    if (!m_was_connected || m_close_requested.load() || !m_auto_reconnect.load()) {
+        Instrumentation::cancel(m_first_tick_handle.exchange(0));
+        return;
+    }
+
+    // Time to first tick counts from when the feed was first lost, across
+    // every failed attempt
+    if (m_reconnect_attempts == 0) {
+        Instrumentation::cancel(m_first_tick_handle.exchange(
+            Instrumentation::start(LatencyTracker::RECONNECT_TO_FIRST_TICK)));
+    }
+
+    long delay_ms = RECONNECT_MAX_DELAY_MS;
+    if (m_reconnect_attempts < 16) {
+        delay_ms = min(RECONNECT_MAX_DELAY_MS, RECONNECT_BASE_DELAY_MS << m_reconnect_attempts);
+    }
+    // Jitter keeps clients that dropped together from retrying in lockstep
+    static thread_local mt19937 jitter(random_device{}());
+    delay_ms = delay_ms / 2 + uniform_int_distribution<long>(0, delay_ms / 2)(jitter);
+    ++m_reconnect_attempts;
+
+    m_status = "Reconnecting";
+    fmt::print(fmt::fg(fmt::color::yellow) | fmt::emphasis::bold,
+               "> Connection {} lost, reconnecting in {} ms (attempt {})\n", m_id, delay_ms, m_reconnect_attempts);
+
+    m_reconnect_timer = set_timer(delay_ms, websocketpp::lib::bind(
+                                  &connection_metadata::on_reconnect_timer,
+                                  shared_from_this(),
+                                  websocketpp::lib::placeholders::_1
+                                  ));
+}
+
+void connection_metadata::cancel_reconnect() {
+    if (m_reconnect_timer) m_reconnect_timer->cancel();
+    Instrumentation::cancel(m_first_tick_handle.exchange(0));
+}
+
+void connection_metadata::on_reconnect_timer(websocketpp::lib::error_code const &ec) {
+    if (ec) return;
+    if (m_close_requested.load() || !m_auto_reconnect.load()) {
+        m_status = "Closed";
+        Instrumentation::cancel(m_first_tick_handle.exchange(0));
+        return;
+    }
+
+    string error;
+    if (!m_endpoint->open_connection(shared_from_this(), error)) {
+        m_error_reason = error;
+        schedule_reconnect();
+    }
+}
+
+// The "error" member of a response as text, for reporting
+static string error_text(dom_json const &response) {
+    return response.contains("error") ? string(response["error"].dump()) : "null";
+}
+
+json connection_metadata::restore_request(string const &method) {
+    return json{
+        {"jsonrpc", "2.0"},
+        {"id", next_request_id(request_id::CLASS_RESTORE)},
+        {"method", method},
+        {"params", json::object()}
+    };
+}
+
+void connection_metadata::replay_auth(string const &stored, function<void(bool)> done) {
+    json original = stored.empty() ? json() : json::parse(stored, nullptr, false);
+    if (original.is_discarded() || !original.is_object() || !original.contains("params")) {
+        done(false);
+        return;
+    }
+
+    // The stored client_credentials grant is re-sent as is (no signature to
+    // recompute) under a new request id, with a fresh timestamp and nonce
+    json request = restore_request("public/auth");
+    request["params"] = original["params"];
+    request["params"]["timestamp"] = utils::time_now();
+    request["params"]["nonce"] = utils::gen_random(10);
+
+    auto self = shared_from_this();
+    int sent = send(request.dump(), [self, done](dom_json const &response) {
+        if (!response.contains("result") || !response["result"].contains("access_token")) {
+            fmt::print(fmt::fg(fmt::color::red) | fmt::emphasis::bold,
+                       "> Authorization of connection {} failed: {}\n", self->m_id,
+                       error_text(response));
+            done(false);
+            return;
+        }
+        {
+            lock_guard<mutex> lock(self->m_session_mutex);
+            self->m_access_token = response["result"]["access_token"].get<string>();
+        }
+        self->m_authorized.store(true);
+        done(true);
+    });
+    if (sent < 0) done(false);
+}
+
+void connection_metadata::authorize(string const &auth_request) {
+    replay_auth(auth_request, [](bool) {});
+}
+
+void connection_metadata::restore_session() {
+    string auth;
+    vector<string> channels;
+    {
+        lock_guard<mutex> lock(m_session_mutex);
+        auth = m_auth_request;
+        channels.assign(m_channels.begin(), m_channels.end());
+    }
+
+    // Spares only need to be logged in again
+    if (m_spare.load()) {
+        if (!auth.empty()) authorize(auth);
+        return;
+    }
+
+    if (auth.empty()) {
+        restore_subscriptions(channels, false);
+        return;
+    }
+
+    auto self = shared_from_this();
+    replay_auth(auth, [self, channels](bool authorized) {
+        if (!authorized) {
+            self->restore_subscriptions(channels, false);
+            return;
+        }
+        Password::password().setAccessToken(self->get_access_token());
+        fmt::print(fmt::fg(fmt::color::green), "> Connection {} re-authorized\n", self->m_id);
+
+        self->restore_subscriptions(channels, true);
+        self->resync_open_orders();
+    });
+}
+
+void connection_metadata::restore_subscriptions(vector<string> const &channels, bool authorized) {
+    // Nothing will tick, so there is no first tick to wait for
+    if (channels.empty()) {
+        Instrumentation::cancel(m_first_tick_handle.exchange(0));
+        return;
+    }
+
+    json request = restore_request(authorized ? "private/subscribe" : "public/subscribe");
+    request["params"]["channels"] = channels;
+
+    int id = m_id;
+    send(request.dump(), [id](dom_json const &response) {
+        if (response.contains("result") && response["result"].is_array()) {
+            fmt::print(fmt::fg(fmt::color::green), "> Restored {} subscription(s) on connection {}\n",
+                       response["result"].size(), id);
+        } else {
+            fmt::print(fmt::fg(fmt::color::red) | fmt::emphasis::bold,
+                       "> Restoring subscriptions on connection {} failed: {}\n", id,
+                       error_text(response));
+        }
+    });
+}
+
+void connection_metadata::resync_open_orders() {
+    json request = restore_request("private/get_open_orders");
+
+    auto self = shared_from_this();
+    send(request.dump(), [self](dom_json const &response) {
+        if (!response.contains("result") || !response["result"].is_array()) {
+            fmt::print(fmt::fg(fmt::color::red) | fmt::emphasis::bold,
+                       "> Resynchronizing open orders on connection {} failed: {}\n", self->m_id,
+                       error_text(response));
+            return;
+        }
+        size_t open_orders = response["result"].size();
+        {
+            lock_guard<mutex> lock(self->m_session_mutex);
+            self->m_open_orders = open_orders;
+        }
+        fmt::print(fmt::fg(fmt::color::green), "> Connection {} has {} open order(s) after reconnecting\n",
+                   self->m_id, open_orders);
+    });
+}
+
+static bool ends_with(string const &method, string const &suffix) {
+    return method.size() >= suffix.size() &&
+           method.compare(method.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Whether a response to this method changes the connection's channel set,
+// checked before building the response's DOM
+static bool changes_channels(string const &method) {
+    return ends_with(method, "/subscribe") || ends_with(method, "/unsubscribe") ||
+           ends_with(method, "/unsubscribe_all");
+}
+
+void connection_metadata::track_channels(string const &method, dom_json const &response) {
+    lock_guard<mutex> lock(m_session_mutex);
+    if (ends_with(method, "/unsubscribe_all")) {
+        m_channels.clear();
+        return;
+    }
+
+    // (un)subscribe results list the channels the exchange acted on
+    if (!response.contains("result") || !response["result"].is_array()) return;
+    bool subscribe = ends_with(method, "/subscribe");
+    if (!subscribe && !ends_with(method, "/unsubscribe")) return;
+
+    for (auto const &channel : response["result"]) {
+        if (!channel.is_string()) continue;
+        if (subscribe) {
+            m_channels.insert(channel.get<string>());
+        } else {
+            m_channels.erase(channel.get<string>());
+        }
+    }
 }
 
 void connection_metadata::on_message(websocketpp::connection_hdl hdl, client::message_ptr msg) {
-    // Start latency tracking
-    getLatencyTracker().start_measurement(
-        LatencyTracker::WEBSOCKET_MESSAGE_PROPAGATION, 
-        "websocket_message_" + to_string(m_id)
-    );
+    // Arrival times, taken before any parsing: ticks for request round-trips,
+    // wall clock for comparison with exchange timestamps
+    uint64_t received_ticks = Instrumentation::now();
+    auto received_wall = chrono::system_clock::now();
 
-    try {
-        if (!msg) return;
+    TRACE_SPAN("on_message");
 
-        string payload = msg->get_payload();
+    if (!msg) return;
 
-        json received_json;
-        try {
-            received_json = json::parse(payload);
-        } catch (const json::parse_error& e) {
-            cerr << "JSON parse error: " << e.what() << endl;
-            cerr << "Problematic payload: " << payload << endl;
+    m_stats.messages_in.fetch_add(1, memory_order_relaxed);
+    m_stats.bytes_in.fetch_add(msg->get_payload().size(), memory_order_relaxed);
+    m_last_received = chrono::steady_clock::now();
+
+    // Clock probes and heartbeats are internal, and their state belongs to
+    // this thread, so answer them here. They are all tiny; skip the scan otherwise.
+    string const &payload = msg->get_payload();
+    json_scan::rpc_fields fields;
+    if (payload.size() < 256 && json_scan::scan_rpc(payload, fields)) {
+        if (fields.has_id) {
+            if (handle_clock_probe(fields, received_wall)) return;
+            if (request_id::class_of(fields.id) == request_id::CLASS_HEARTBEAT &&
+                handle_heartbeat_response(fields, received_ticks)) return;
+        } else if (handle_heartbeat(fields)) {
             return;
         }
+    }
 
-        if (received_json.contains("method")) {
-            string method = received_json.value("method", "");
+    // Everything else is handed to the consumer thread untouched, so socket
+    // reads never wait on parsing or printing
+    inbound_message message;
+    message.payload = move(msg->get_raw_payload());
+    message.opcode = msg->get_opcode();
+    message.received_ticks = received_ticks;
+    message.received_wall = received_wall;
+    message.latency_handle = Instrumentation::start(LatencyTracker::WEBSOCKET_MESSAGE_PROPAGATION);
 
-            if (method == "subscription" && isStreaming) {
-                auto params = received_json.value("params", json{});
-                auto data = params.value("data", json{});
+    LatencyTracker::Handle latency_handle = message.latency_handle;
+    if (!m_inbox.push(move(message))) {
+        Instrumentation::cancel(latency_handle);
+        return;
+    }
+
+    // Pairs with the fence in consume_messages(): either the consumer sees
+    // the new item before sleeping, or we see it asleep and wake it
+    atomic_thread_fence(memory_order_seq_cst);
+    if (m_consumer_sleeping.load(memory_order_relaxed)) {
+        lock_guard<mutex> lock(m_inbox_mutex);
+        m_inbox_cv.notify_one();
+    }
+}
+
+void connection_metadata::start_consumer() {
+    m_consumer_running.store(true, memory_order_release);
+    m_consumer = thread(&connection_metadata::consume_messages, this);
+}
+
+void connection_metadata::stop_consumer() {
+    if (!m_consumer.joinable()) return;
+    {
+        lock_guard<mutex> lock(m_inbox_mutex);
+        m_consumer_running.store(false, memory_order_release);
+        m_inbox_cv.notify_one();
+    }
+    m_consumer.join();
+}
+
+void connection_metadata::consume_messages() {
+    getTracer().set_thread_name("consumer");
+
+    inbound_message message;
+    int idle_spins = 0;
+
+    while (true) {
+        if (m_inbox.pop(message)) {
+            idle_spins = 0;
+            process_message(message);
+            continue;
+        }
+        // Drained; only now honour a stop request
+        if (!m_consumer_running.load(memory_order_acquire)) break;
+
+        // Spin briefly for the next message before paying for a sleep
+        if (++idle_spins < CONSUMER_SPIN_LIMIT) {
+            io_loop_cpu_relax();
+            continue;
+        }
+
+        unique_lock<mutex> lock(m_inbox_mutex);
+        m_consumer_sleeping.store(true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (m_inbox.empty() && m_consumer_running.load(memory_order_acquire)) {
+            m_inbox_cv.wait_for(lock, chrono::milliseconds(100));
+        }
+        m_consumer_sleeping.store(false, memory_order_relaxed);
+        idle_spins = 0;
+    }
+}
+
+// One line under a streamed notification, from its decoded update
+static void print_feed_update(feed::decoder const &decoder, feed::channel_kind kind) {
+    switch (kind) {
+        case feed::CHANNEL_PRICE_INDEX: {
+            feed::price_index_update const &index = decoder.price_index();
+            fmt::print(fmt::fg(fmt::color::green) | fmt::emphasis::bold,
+                       "Price: {} ", feed::to_double(index.price));
+            fmt::print(fmt::fg(fmt::color::yellow),
+                       "Timestamp: {} ", index.timestamp_ms);
+            fmt::print(fmt::fg(fmt::color::cyan),
+                       "Index: {}\n", index.index_name);
+            break;
+        }
+        case feed::CHANNEL_TICKER: {
+            feed::ticker_update const &ticker = decoder.ticker();
+            fmt::print(fmt::fg(fmt::color::green) | fmt::emphasis::bold,
+                       "Bid: {} x {} ", feed::to_double(ticker.best_bid_price), feed::to_double(ticker.best_bid_amount));
+            fmt::print(fmt::fg(fmt::color::red) | fmt::emphasis::bold,
+                       "Ask: {} x {} ", feed::to_double(ticker.best_ask_price), feed::to_double(ticker.best_ask_amount));
+            fmt::print(fmt::fg(fmt::color::yellow),
+                       "Last: {} Mark: {} ", feed::to_double(ticker.last_price), feed::to_double(ticker.mark_price));
+            fmt::print(fmt::fg(fmt::color::cyan),
+                       "Instrument: {}\n", ticker.instrument_name);
+            break;
+        }
+        case feed::CHANNEL_BOOK: {
+            feed::book_update const &book = decoder.book();
+            fmt::print(fmt::fg(fmt::color::green) | fmt::emphasis::bold,
+                       "{}: {} bid and {} ask levels ", book.snapshot ? "Snapshot" : "Change",
+                       book.bids.size(), book.asks.size());
+            fmt::print(fmt::fg(fmt::color::yellow),
+                       "Change id: {} ", book.change_id);
+            fmt::print(fmt::fg(fmt::color::cyan),
+                       "Instrument: {}\n", book.instrument_name);
+            break;
+        }
+        case feed::CHANNEL_TRADES: {
+            feed::trades_update const &trades = decoder.trades();
+            feed::trade const &last = trades.trades.back();
+            fmt::print(fmt::fg(fmt::color::green) | fmt::emphasis::bold,
+                       "Trades: {} ", trades.trades.size());
+            fmt::print(fmt::fg(fmt::color::yellow),
+                       "Last: {} {} @ {} ", last.buy ? "buy" : "sell", feed::to_double(last.amount),
+                       feed::to_double(last.price));
+            fmt::print(fmt::fg(fmt::color::cyan),
+                       "Instrument: {}\n", trades.instrument_name);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void connection_metadata::process_message(inbound_message &message) {
+    TRACE_SPAN("process_message");
+
+    uint64_t received_ticks = message.received_ticks;
+    auto received_wall = message.received_wall;
+    LatencyTracker::Handle latency_handle = message.latency_handle;
+
+    try {
+        string const &payload = message.payload;
+
+        // Routing and feed latency only need a few fields, found in place;
+        // the DOM is built only for whatever displays or handles the message
+        json_scan::rpc_fields fields;
+        {
+            TRACE_SPAN("json_scan");
+            if (!json_scan::scan_rpc(payload, fields)) {
+                cerr << "JSON parse error: not a well-formed JSON object" << endl;
+                cerr << "Problematic payload: " << payload << endl;
+                Instrumentation::cancel(latency_handle);
+                return;
+            }
+        }
+
+        // Declared before the DOM, so the DOM is gone before the arena resets
+        arena_scope dom_scope(m_dom_arena);
+        dom_json received_json;
+        bool parsed = false;
+        auto dom = [&]() -> dom_json & {
+            if (!parsed) {
+                TRACE_SPAN("json::parse");
+                received_json = dom_json::parse(payload);
+                parsed = true;
+            }
+            return received_json;
+        };
+
+        // Route a response to whoever sent the request with the same id
+        pending_request request;
+        if (fields.has_id) take_pending(fields.id, request);
+        Instrumentation::stop(request.latency_handle, received_ticks);
+        if (changes_channels(request.method)) track_channels(request.method, dom());
+
+        if (!fields.method.empty()) {
+            string_view method = fields.method;
+
+            // First tick since the connection dropped
+            if (method == "subscription" && m_first_tick_handle.load(memory_order_relaxed) != 0) {
+                Instrumentation::stop(m_first_tick_handle.exchange(0), received_ticks);
+            }
 
-                if (!data.is_null() && data.is_object()) {
+            // Book, ticker, trades and price index frames decode straight
+            // into m_feed_decoder's updates
+            feed::channel_kind feed_kind = feed::CHANNEL_OTHER;
+            if (method == "subscription") {
+                TRACE_SPAN("feed_decode");
+                feed_kind = m_feed_decoder.decode(fields.channel, fields.data);
+            }
+
+            if (DERIBIT_INSTRUMENTATION_LEVEL != DERIBIT_INSTRUMENTATION_OFF && method == "subscription") {
+                record_feed_latency(fields.channel,
+                                    feed_kind != feed::CHANNEL_OTHER ? m_feed_decoder.timestamp_ms()
+                                                                     : feed_timestamp_ms(fields.data),
+                                    received_wall);
+            }
+
+            if (method == "subscription" && isStreaming) {
+                TRACE_SPAN("print_subscription");
+                // Decoded channels print from the packed update; only the
+                // others fall back to the generic DOM
+                if (feed_kind != feed::CHANNEL_OTHER) {
                     utils::clear_console();
                     fmt::print(fmt::fg(fmt::color::blue) | fmt::emphasis::bold,
                         "> (Press q to stop streaming)\n\n");
-                    cout << "Subscription Data: " << data.dump(4) << endl;
-
-                    if (data.contains("price") && data["price"].is_number() &&
-                        data.contains("timestamp") && data["timestamp"].is_number() &&
-                        data.contains("index_name") && data["index_name"].is_string()) {
-                        double price = data["price"];
-                        int64_t timestamp = data["timestamp"];
-                        string index_name = data["index_name"];
-
-                        fmt::print(fmt::fg(fmt::color::green) | fmt::emphasis::bold,
-                                   "Price: {} ", price);
-                        fmt::print(fmt::fg(fmt::color::yellow),
-                                   "Timestamp: {} ", timestamp);
-                        fmt::print(fmt::fg(fmt::color::cyan),
-                                   "Index: {}\n", index_name);
+                    print_feed_update(m_feed_decoder, feed_kind);
+                } else {
+                    auto params = dom().value("params", dom_json{});
+                    auto data = params.value("data", dom_json{});
+
+                    if (data.is_object() || data.is_array()) {
+                        utils::clear_console();
+                        fmt::print(fmt::fg(fmt::color::blue) | fmt::emphasis::bold,
+                            "> (Press q to stop streaming)\n\n");
+                        cout << "Subscription Data: " << data.dump(4) << endl;
                     } else {
-                        cerr << "Unexpected data format" << endl;
+                        cerr << "Invalid or null data received" << endl;
                     }
-                } else {
-                    cerr << "Invalid or null data received" << endl;
                 }
             }
         }
-        if(!isStreaming){
-            if (msg->get_opcode() == websocketpp::frame::opcode::text) {
-                m_messages.push_back("RECEIVED: " + msg->get_payload());
-            record_summary(msg->get_payload(), "RECEIVED");
-            } else {
-                m_messages.push_back("RECEIVED: " + websocketpp::utility::to_hex(msg->get_payload()));
-            record_summary(websocketpp::utility::to_hex(msg->get_payload()), "RECEIVED");
+        // Spares are silent until handed out
+        if(!isStreaming && !m_spare.load(memory_order_relaxed)){
+            {
+                TRACE_SPAN("record_summary");
+                if (message.opcode == websocketpp::frame::opcode::text) {
+                    m_messages.append("RECEIVED: " + payload);
+                    record_summary(dom(), "RECEIVED");
+                } else {
+                    m_messages.append("RECEIVED: " + websocketpp::utility::to_hex(payload));
+                    record_summary(websocketpp::utility::to_hex(payload), "RECEIVED");
+                }
             }
-            if (msg->get_payload()[0] == '{') {
-                cout << "Received message: " << utils::pretty(msg->get_payload()) << endl;
+            TRACE_SPAN("print_response");
+            if (payload[0] == '{') {
+                cout << "Received message: " << utils::pretty(payload) << endl;
             }
             else{
-                cout << "Received message: " << msg->get_payload() << endl;
+                cout << "Received message: " << payload << endl;
             }
         }
 
-        if (AUTH_SENT && received_json.contains("result") && 
-            received_json["result"].contains("access_token")) {
-            Password::password().setAccessToken(received_json["result"]["access_token"]);
+        if (AUTH_SENT && !fields.result.empty() &&
+            dom()["result"].contains("access_token")) {
+            Password::password().setAccessToken(received_json["result"]["access_token"].get<string>());
             utils::printcmd("Authorization successful!\n");
             AUTH_SENT = false;
         }
 
-        MSG_PROCESSED = true;
-        cv.notify_one();
+        // Last, so a waiter that wakes up on it sees the printed response
+        if (request.handler) {
+            TRACE_SPAN("response_handler");
+            request.handler(dom());
+        }
     }
     catch (const exception& e) {
         cerr << "Error processing message: " << e.what() << endl;
-        MSG_PROCESSED = true;
-        cv.notify_one();
     }
 
     // Stop latency tracking
-    getLatencyTracker().stop_measurement(
-        LatencyTracker::WEBSOCKET_MESSAGE_PROPAGATION, 
-        "websocket_message_" + to_string(m_id)
-    );
+    Instrumentation::stop(latency_handle);
 }
 
 int websocket_endpoint::streamSubscriptions(const vector<string>& connections) {
@@ -340,7 +1238,6 @@ int websocket_endpoint::streamSubscriptions(const vector<string>& connections) {
 
     json subscribe = {
         {"jsonrpc", "2.0"},
-        {"id", 4235},
         {"method", "private/subscribe"},
         {"params", {
             {"channels", connections}
@@ -349,8 +1246,12 @@ int websocket_endpoint::streamSubscriptions(const vector<string>& connections) {
     
     isStreaming = true;
     
-    if (!m_connection_list.empty()) {
-        int connectionId = m_connection_list.begin()->first;
+    auto first = m_connection_list.begin();
+    while (first != m_connection_list.end() && first->second->is_spare()) ++first;
+
+    if (first != m_connection_list.end()) {
+        int connectionId = first->first;
+        subscribe["id"] = request_id::next(connectionId, request_id::CLASS_API);
         
         send(connectionId, subscribe.dump());
         
@@ -376,7 +1277,7 @@ int websocket_endpoint::streamSubscriptions(const vector<string>& connections) {
                     // Unsubscribe
                     json unsubscribe = {
                         {"jsonrpc", "2.0"},
-                        {"id", 154},
+                        {"id", request_id::next(connectionId, request_id::CLASS_API)},
                         {"method", "private/unsubscribe_all"},
                         {"params", {}}
                     };
@@ -409,12 +1310,61 @@ ostream &operator<< (ostream &out, connection_metadata const &data) {
     out << "> URI: " << data.m_uri << "\n"
         << "> Status: " << data.m_status << "\n"
         << "> Remote Server: " << (data.m_server.empty() ? "None Specified" : data.m_server) << "\n"
-        << "> Error/close reason: " << (data.m_error_reason.empty() ? "N/A" : data.m_error_reason) << "\n"
-        << "> Messages Processed: (" << data.m_messages.size() << ") \n";
- 
-    vector<string>::const_iterator it;
-    for (it = data.m_summaries.begin(); it != data.m_summaries.end(); ++it) {
-        out << *it << "\n";
+        << "> Error/close reason: " << (data.m_error_reason.empty() ? "N/A" : data.m_error_reason) << "\n";
+
+    if (data.m_spare.load()) {
+        out << "> Spare: " << (data.m_authorized.load() ? "logged in, " : "") << "waiting in the pool\n";
+    }
+    if (data.m_compress) {
+        out << "> permessage-deflate: " << (data.m_deflate_negotiated.load() ? "negotiated" : "offered, not accepted")
+            << "\n";
+    }
+    if (data.m_connect_us.load() >= 0) {
+        out << "> Connected in " << data.m_connect_us.load() / 1000.0 << " ms ("
+            << (data.is_plain() ? "no TLS" : data.m_tls_resumed.load() ? "TLS session resumed" : "full TLS handshake")
+            << ")\n";
+    }
+
+    out << "> Auto-reconnect: " << (data.m_auto_reconnect.load() ? "on" : "off");
+    {
+        lock_guard<mutex> lock(const_cast<mutex&>(data.m_session_mutex));
+        out << " (" << data.m_channels.size() << " channel(s) to restore";
+        if (!data.m_auth_request.empty()) out << ", re-authorizes";
+        out << ", " << data.m_open_orders << " open order(s) at last resync)\n";
+    }
+
+    if (data.m_endpoint) {
+        out << "> I/O thread: " << data.m_endpoint->describe_io_thread(data.m_role) << "\n";
+    }
+
+    out << "> Heartbeat: every " << connection_metadata::HEARTBEAT_INTERVAL_S << " s, "
+        << data.m_heartbeats_received.load(memory_order_relaxed) << " received";
+    if (data.m_heartbeat_rtt_us.load(memory_order_relaxed) >= 0) {
+        out << ", last test RTT " << data.m_heartbeat_rtt_us.load(memory_order_relaxed) << " µs";
+    }
+    out << "\n";
+
+    if (data.m_clock_offset.has_estimate()) {
+        out << "> Exchange clock offset: " << data.m_clock_offset.offset_us() << " µs (probe RTT "
+            << data.m_clock_offset.rtt_us() << " µs)\n";
+    }
+
+    out << "> Inbox: high water " << data.m_inbox.high_water() << " / " << data.m_inbox.capacity()
+        << ", dropped " << data.m_inbox.dropped() << "\n";
+
+    out << "> Messages Processed: (" << data.m_messages.total() << ") \n";
+    out << "> History: " << data.m_messages.size() << " retained (" << data.m_messages.bytes() / 1024 << " KiB), "
+        << data.m_messages.evicted() << " evicted";
+    if (!data.m_messages.spill_file().empty()) {
+        out << " to " << data.m_messages.spill_file();
+    }
+    out << "\n";
+
+    if (data.m_summaries.evicted() > 0) {
+        out << "> (" << data.m_summaries.evicted() << " older summaries not shown)\n";
+    }
+    for (auto const &summary : data.m_summaries.page(0, data.m_summaries.size())) {
+        out << summary.text << "\n";
     }
     return out;
 }
@@ -433,72 +1383,345 @@ context_ptr on_tls_init() {
     return context;
 }
 
-websocket_endpoint::websocket_endpoint(): m_next_id(0) {
-    m_endpoint.clear_access_channels(websocketpp::log::alevel::all);
-    m_endpoint.clear_error_channels(websocketpp::log::elevel::all);
+// Applies placement to a running thread; an empty config restores the
+// defaults (all CPUs, SCHED_OTHER).
+static bool apply_io_thread_config(pthread_t thread, io_thread_config const &config, string &error) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (config.cpu >= 0) {
+        CPU_SET(config.cpu, &cpus);
+    } else {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &cpus);
+    }
+    int rc = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+    if (rc != 0 && config.cpu >= 0) {
+        error = "cannot pin to CPU " + to_string(config.cpu) + ": " + strerror(rc);
+        return false;
+    }
 
-    m_endpoint.init_asio();
-    m_endpoint.start_perpetual();
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config.fifo_priority;
+    rc = pthread_setschedparam(thread, config.fifo_priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+    if (rc != 0) {
+        error = string("cannot set SCHED_FIFO priority: ") + strerror(rc);
+        return false;
+    }
+    return true;
+}
 
-    m_thread.reset(new websocketpp::lib::thread(&client::run, &m_endpoint));
+// Hands every connection of endpoint the shared context, and offers it the
+// cached TLS session for its host
+template <typename Client>
+static void use_tls_sessions(Client &endpoint, tls_session_cache &sessions) {
+    context_ptr context = sessions.context();
+    endpoint.set_tls_init_handler([context](websocketpp::connection_hdl) {
+        return context;
+    });
+    endpoint.set_socket_init_handler([&endpoint, &sessions](websocketpp::connection_hdl hdl,
+                                                            boost::asio::ssl::stream<boost::asio::ip::tcp::socket> &socket) {
+        typename Client::connection_ptr con = endpoint.get_con_from_hdl(hdl);
+        sessions.attach(socket.native_handle(), con->get_host() + ":" + to_string(con->get_port()));
+    });
+}
+
+websocket_endpoint::websocket_endpoint(): m_tls_sessions(on_tls_init()), m_next_id(0) {
+    for (auto &slot : m_exported_connections) {
+        slot.store(nullptr, memory_order_relaxed);
+    }
+
+    for (int role = 0; role < IO_ROLE_COUNT; ++role) {
+        io_shard &shard = m_shards[role];
+
+        shard.endpoint.clear_access_channels(websocketpp::log::alevel::all);
+        shard.endpoint.clear_error_channels(websocketpp::log::elevel::all);
+
+        shard.endpoint.init_asio();
+        shard.endpoint.start_perpetual();
+
+        shard.deflate_endpoint.clear_access_channels(websocketpp::log::alevel::all);
+        shard.deflate_endpoint.clear_error_channels(websocketpp::log::elevel::all);
+        shard.deflate_endpoint.init_asio(&shard.endpoint.get_io_service());
+
+        shard.plain_endpoint.clear_access_channels(websocketpp::log::alevel::all);
+        shard.plain_endpoint.clear_error_channels(websocketpp::log::elevel::all);
+        shard.plain_endpoint.init_asio(&shard.endpoint.get_io_service());
+
+        // One context for all connections, so TLS sessions can be resumed
+        use_tls_sessions(shard.endpoint, m_tls_sessions);
+        use_tls_sessions(shard.deflate_endpoint, m_tls_sessions);
+
+        shard.thread.reset(new websocketpp::lib::thread([&shard, role]() {
+            shard.tid.store(syscall(SYS_gettid), memory_order_release);
+            getTracer().set_thread_name(role == IO_ROLE_MARKET_DATA ? "market-data-io" : "trading-io");
+            run_io_loop(shard.endpoint.get_io_service(), shard.mode);
+        }));
+    }
 }
 
 websocket_endpoint::~websocket_endpoint() {
-    m_endpoint.stop_perpetual();
+    for (auto &shard : m_shards) {
+        shard.endpoint.stop_perpetual();
+    }
+
+    // Clock probe and reconnect timers would otherwise keep the I/O threads
+    // alive; they can only be cancelled safely from the thread that owns them
+    for (auto const &entry : m_connection_list) {
+        connection_metadata::ptr metadata = entry.second;
+        metadata->request_close();
+        boost::asio::post(io_service_for(metadata), [metadata]() {
+            metadata->cancel_clock_probe();
+            metadata->cancel_heartbeat();
+            metadata->cancel_reconnect();
+        });
+    }
 
     for (con_list::const_iterator it = m_connection_list.begin(); it != m_connection_list.end(); ++it) {
-        if (it->second->get_status() != "Open") {
+        if (it->second->get_status() != "Connected") {
             continue;
         }
         
         cout << "> Closing connection " << it->second->get_id() << endl;
         
         websocketpp::lib::error_code ec;
-        m_endpoint.close(it->second->get_hdl(), websocketpp::close::status::going_away, "", ec);
+        it->second->close(websocketpp::close::status::going_away, "", ec);
         if (ec) {
             cout << "> Error closing connection " << it->second->get_id() << ": "  
                     << ec.message() << endl;
         }
     }
     
-    m_thread->join();
+    for (auto &shard : m_shards) {
+        shard.thread->join();
+    }
+
+    // Nothing more can arrive once the I/O threads are gone
+    for (auto const &entry : m_connection_list) {
+        entry.second->stop_consumer();
+    }
 }
 
-int websocket_endpoint::connect(string const &uri) {
+const char* websocket_endpoint::io_role_name(io_role role) {
+    return role == IO_ROLE_MARKET_DATA ? "market-data" : "trading";
+}
+
+bool websocket_endpoint::parse_io_role(string const &name, io_role &role) {
+    if (name == "market" || name == "market-data" || name == "md") {
+        role = IO_ROLE_MARKET_DATA;
+    } else if (name == "trading" || name == "trade") {
+        role = IO_ROLE_TRADING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool websocket_endpoint::set_io_thread_config(io_role role, io_thread_config const &config, string &error) {
+    io_shard &shard = m_shards[role];
+    if (!apply_io_thread_config(shard.thread->native_handle(), config, error)) return false;
+    shard.config = config;
+
+    // Wake the loop in case it is blocked in run_one() under the old mode
+    shard.mode.busy_poll_us.store(config.busy_poll_us, memory_order_relaxed);
+    boost::asio::post(shard.endpoint.get_io_service(), []() {});
+    return true;
+}
+
+string websocket_endpoint::describe_io_thread(io_role role) const {
+    const io_shard &shard = m_shards[role];
+    pthread_t thread = const_cast<websocketpp::lib::thread&>(*shard.thread).native_handle();
+
+    stringstream s;
+    s << io_role_name(role) << " (tid " << shard.tid.load(memory_order_acquire);
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (pthread_getaffinity_np(thread, sizeof(cpus), &cpus) == 0) {
+        int count = CPU_COUNT(&cpus);
+        if (count == 1) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &cpus)) s << ", CPU " << cpu;
+            }
+        } else {
+            s << ", unpinned (" << count << " CPUs)";
+        }
+    }
+
+    int policy;
+    sched_param param;
+    if (pthread_getschedparam(thread, &policy, &param) == 0) {
+        if (policy == SCHED_FIFO) {
+            s << ", SCHED_FIFO " << param.sched_priority;
+        } else {
+            s << ", SCHED_OTHER";
+        }
+    }
+
+    long busy_poll_us = shard.mode.busy_poll_us.load(memory_order_relaxed);
+    if (busy_poll_us == 0) {
+        s << ", busy-poll";
+    } else if (busy_poll_us > 0) {
+        s << ", busy-poll (blocks after " << busy_poll_us << " µs idle)";
+    }
+    s << ")";
+    return s.str();
+}
+
+int websocket_endpoint::connect(string const &uri, io_role role, bool compress) {
+    if (compress && role != IO_ROLE_MARKET_DATA) {
+        cout << "> permessage-deflate is only offered on market-data connections" << endl;
+        return -1;
+    }
+    if (compress && connection_metadata::is_plain_uri(uri)) {
+        cout << "> permessage-deflate is only offered over wss://" << endl;
+        return -1;
+    }
+
+    int id = take_spare(uri, role, compress);
+    if (id >= 0) {
+        fill_spare_pool(role);
+        return id;
+    }
+    return create_connection(uri, role, false, compress);
+}
+
+int websocket_endpoint::create_connection(string const &uri, io_role role, bool spare, bool compress) {
     int new_id = m_next_id++;
 
-    m_endpoint.set_tls_init_handler(websocketpp::lib::bind(
-                                    &on_tls_init
-                                    ));
+    connection_metadata::ptr metadata_ptr(new connection_metadata(new_id, websocketpp::connection_hdl(), uri, this,
+                                                                  role, compress));
+    metadata_ptr->set_spare(spare);
+
+    string error;
+    if (!open_connection(metadata_ptr, error)) {
+        cout << "Connection initialization error: " << error << endl;
+        return -1;
+    }
+
+    metadata_ptr->start_consumer();
+    m_connection_list[new_id] = metadata_ptr;
+    if (new_id < MAX_EXPORTED_CONNECTIONS) {
+        m_exported_connections[new_id].store(metadata_ptr.get(), memory_order_release);
+    }
+
+    return new_id;
+}
+
+int websocket_endpoint::take_spare(string const &uri, io_role role, bool compress) {
+    bool needs_auth = !auth_request().empty();
+
+    for (auto const &entry : m_connection_list) {
+        connection_metadata::ptr const &metadata = entry.second;
+        if (!metadata->is_spare() || metadata->get_role() != role || metadata->get_uri() != uri ||
+            metadata->is_compressed() != compress ||
+            metadata->get_status() != "Connected" || (needs_auth && !metadata->is_authorized())) {
+            continue;
+        }
+
+        metadata->set_spare(false);
+        if (metadata->is_authorized()) {
+            Password::password().setAccessToken(metadata->get_access_token());
+        }
+        return entry.first;
+    }
+    return -1;
+}
+
+void websocket_endpoint::fill_spare_pool(io_role role) {
+    spare_pool const &pool = m_spare_pools[role];
+
+    // Spares that are warming up or reconnecting count too
+    size_t spares = 0;
+    for (auto const &entry : m_connection_list) {
+        connection_metadata::ptr const &metadata = entry.second;
+        if (metadata->is_spare() && metadata->get_role() == role && metadata->get_uri() == pool.uri &&
+            !metadata->is_compressed() &&
+            metadata->get_status() != "Closed" && metadata->get_status() != "Failed") {
+            ++spares;
+        }
+    }
+
+    for (; spares < pool.target; ++spares) {
+        if (create_connection(pool.uri, role, true, false) < 0) break;
+    }
+}
+
+void websocket_endpoint::set_spare_pool(io_role role, string const &uri, size_t count) {
+    spare_pool &pool = m_spare_pools[role];
+
+    // Spares no longer wanted are closed
+    for (auto const &entry : m_connection_list) {
+        connection_metadata::ptr const &metadata = entry.second;
+        if (metadata->is_spare() && metadata->get_role() == role &&
+            (metadata->get_uri() != uri || count == 0) && metadata->get_status() == "Connected") {
+            close(entry.first, websocketpp::close::status::normal, "spare no longer needed");
+        }
+    }
 
+    pool.uri = uri;
+    pool.target = count;
+    fill_spare_pool(role);
+}
+
+string websocket_endpoint::describe_spare_pool(io_role role) const {
+    spare_pool const &pool = m_spare_pools[role];
+    bool needs_auth = !auth_request().empty();
+
+    stringstream s;
+    if (pool.target == 0) {
+        s << "no spares";
+    } else {
+        size_t ready = 0;
+        for (auto const &entry : m_connection_list) {
+            connection_metadata::ptr const &metadata = entry.second;
+            if (metadata->is_spare() && metadata->get_role() == role && metadata->get_uri() == pool.uri &&
+                metadata->get_status() == "Connected" && (!needs_auth || metadata->is_authorized())) {
+                ++ready;
+            }
+        }
+        s << ready << "/" << pool.target << " ready for " << pool.uri;
+    }
+    s << " (TLS: " << m_tls_sessions.full_handshakes() << " full, "
+      << m_tls_sessions.resumed_handshakes() << " resumed handshakes)";
+    return s.str();
+}
+
+string websocket_endpoint::auth_request() const {
+    lock_guard<mutex> lock(m_auth_mutex);
+    return m_auth_request;
+}
+
+// Creates a websocketpp connection for metadata on endpoint, wired to its
+// handlers, and starts connecting
+template <typename Client>
+static bool open_connection_on(Client &endpoint, connection_metadata::ptr const &metadata_ptr, string &error) {
     websocketpp::lib::error_code ec;
-    client::connection_ptr con = m_endpoint.get_connection(uri, ec);
+    typename Client::connection_ptr con = endpoint.get_connection(metadata_ptr->get_uri(), ec);
 
     if(ec){
-        cout << "Connection initialization error: " << ec.message() << endl;
-        return -1;
+        error = ec.message();
+        return false;
     }
 
-    connection_metadata::ptr metadata_ptr(new connection_metadata(new_id, con->get_handle(), uri, this));
-    m_connection_list[new_id] = metadata_ptr;
+    metadata_ptr->set_connection(&endpoint, con->get_handle());
 
     con->set_open_handler(websocketpp::lib::bind(
-                          &connection_metadata::on_open,
+                          &connection_metadata::on_open<Client>,
                           metadata_ptr,
-                          &m_endpoint,
+                          &endpoint,
                           websocketpp::lib::placeholders::_1
                           ));
 
     con->set_fail_handler(websocketpp::lib::bind(
-                          &connection_metadata::on_fail,
+                          &connection_metadata::on_fail<Client>,
                           metadata_ptr,
-                          &m_endpoint,
+                          &endpoint,
                           websocketpp::lib::placeholders::_1
                           ));
     con->set_close_handler(websocketpp::lib::bind(
-                           &connection_metadata::on_close,
+                           &connection_metadata::on_close<Client>,
                            metadata_ptr,
-                           &m_endpoint,
+                           &endpoint,
                            websocketpp::lib::placeholders::_1
                           ));
     con->set_message_handler(websocketpp::lib::bind(
@@ -508,9 +1731,20 @@ int websocket_endpoint::connect(string const &uri) {
                              websocketpp::lib::placeholders::_2
                             ));
 
-    m_endpoint.connect(con);
+    endpoint.connect(con);
 
-    return new_id;
+    return true;
+}
+
+bool websocket_endpoint::open_connection(connection_metadata::ptr const &metadata_ptr, string &error) {
+    io_shard &shard = m_shards[metadata_ptr->get_role()];
+    if (metadata_ptr->is_plain()) {
+        return open_connection_on(shard.plain_endpoint, metadata_ptr, error);
+    }
+    if (metadata_ptr->is_compressed()) {
+        return open_connection_on(shard.deflate_endpoint, metadata_ptr, error);
+    }
+    return open_connection_on(shard.endpoint, metadata_ptr, error);
 }
 
 connection_metadata::ptr websocket_endpoint::get_metadata(int id) const {
@@ -529,31 +1763,107 @@ void websocket_endpoint::close(int id, websocketpp::close::status::value code, s
         cout << "> No connection found with id " << id << endl;
         return;
     }
-    
-    m_endpoint.close(it->second->get_hdl(), code, reason, ec);
+
+    // Not a drop: don't reconnect, and abandon any reconnect in progress
+    connection_metadata::ptr metadata = it->second;
+    metadata->request_close();
+    boost::asio::post(io_service_for(metadata), [metadata]() {
+        metadata->cancel_reconnect();
+    });
+
+    it->second->close(code, reason, ec);
     if (ec) {
         cout << "> Error closing connection " << id << ": "  
                   << ec.message() << endl;
     }
 }
 
-int websocket_endpoint::send(int id, string message) {
-    websocketpp::lib::error_code ec;
-    
+int websocket_endpoint::send(int id, string message, connection_metadata::response_handler handler) {
+    TRACE_SPAN("websocket_endpoint::send");
+
     con_list::iterator it = m_connection_list.find(id);
     if (it == m_connection_list.end()) {
         cout << "> No connection found with id " << id << endl;
         return -1;
     }
-    
-    m_endpoint.send(it->second->get_hdl(), message, websocketpp::frame::opcode::text, ec);
-    
-    if (ec) {
-        cout << "> Error sending message to connection " << id << ": "  
-                  << ec.message() << endl;
-        return -1;
+
+    int sent = it->second->send(message, move(handler));
+
+    // Spares log in with the same credentials as the user
+    long long request_id;
+    string method;
+    if (sent == 0 && utils::peek_rpc_header(message, request_id, method) && method == "public/auth") {
+        {
+            lock_guard<mutex> lock(m_auth_mutex);
+            m_auth_request = message;
+        }
+        for (auto const &entry : m_connection_list) {
+            if (entry.second->is_spare() && entry.second->get_status() == "Connected") {
+                entry.second->authorize(message);
+            }
+        }
     }
-    
-    it->second->record_sent_message(message);
-    return 0;
-}
\ No newline at end of file
+    return sent;
+}
+
+future<json> websocket_endpoint::send_request(int id, string message) {
+    auto response = make_shared<promise<json>>();
+    future<json> result = response->get_future();
+
+    // Only the outcome is copied out of the consumer's arena
+    int sent = send(id, move(message), [response](dom_json const &reply) {
+        json outcome = {{"id", reply.value("id", dom_json())}};
+        if (reply.contains("error")) outcome["error"] = json(reply["error"]);
+        response->set_value(move(outcome));
+    });
+    if (sent < 0) return future<json>();
+    return result;
+}
+
+void websocket_endpoint::write_openmetrics(ostream &out) const {
+    struct counter_family {
+        const char* name;
+        const char* help;
+        atomic<uint64_t> connection_stats::*counter;
+    };
+    const counter_family families[] = {
+        {"deribit_ws_messages_received_total", "WebSocket messages received", &connection_stats::messages_in},
+        {"deribit_ws_bytes_received_total", "WebSocket payload bytes received", &connection_stats::bytes_in},
+        {"deribit_ws_messages_sent_total", "WebSocket messages sent", &connection_stats::messages_out},
+        {"deribit_ws_bytes_sent_total", "WebSocket payload bytes sent", &connection_stats::bytes_out}
+    };
+
+    for (auto const &family : families) {
+        out << "# HELP " << family.name << " " << family.help << "\n"
+            << "# TYPE " << family.name << " counter\n";
+
+        for (int id = 0; id < MAX_EXPORTED_CONNECTIONS; ++id) {
+            connection_metadata* metadata = m_exported_connections[id].load(memory_order_acquire);
+            if (!metadata) continue;
+
+            out << family.name << "{connection=\"" << id << "\",uri=\""
+                << utils::openmetrics_label(metadata->get_uri()) << "\"} "
+                << (metadata->get_stats().*family.counter).load(memory_order_relaxed) << "\n";
+        }
+    }
+
+    out << "# HELP deribit_ws_inbox_high_water Deepest the I/O-to-consumer queue has been\n"
+        << "# TYPE deribit_ws_inbox_high_water gauge\n";
+    for (int id = 0; id < MAX_EXPORTED_CONNECTIONS; ++id) {
+        connection_metadata* metadata = m_exported_connections[id].load(memory_order_acquire);
+        if (!metadata) continue;
+        out << "deribit_ws_inbox_high_water{connection=\"" << id << "\",uri=\""
+            << utils::openmetrics_label(metadata->get_uri()) << "\"} "
+            << metadata->inbox_high_water() << "\n";
+    }
+
+    out << "# HELP deribit_ws_inbox_dropped_total Messages dropped because the consumer fell behind\n"
+        << "# TYPE deribit_ws_inbox_dropped_total counter\n";
+    for (int id = 0; id < MAX_EXPORTED_CONNECTIONS; ++id) {
+        connection_metadata* metadata = m_exported_connections[id].load(memory_order_acquire);
+        if (!metadata) continue;
+        out << "deribit_ws_inbox_dropped_total{connection=\"" << id << "\",uri=\""
+            << utils::openmetrics_label(metadata->get_uri()) << "\"} "
+            << metadata->inbox_dropped() << "\n";
+    }
+}